@@ -0,0 +1,127 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_BENCH_
+#define _IPROG_BENCH_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <iprog/thread.hpp>
+
+// Bits shared by the benchmarks in this directory.  Each benchmark is a
+// program of its own, built from the root of the repository like so:
+//
+//     g++ -O2 -std=c++11 -Iinclude bench/<name>.cpp src/*.cpp -o <name>.exe
+//
+// and prints one line per configuration it tries.  They take no arguments
+// besides an optional thread count, which defaults to the number of cores.
+
+namespace bench {
+
+inline int64_t nanoseconds() {
+	using namespace std::chrono;
+	return duration_cast<std::chrono::nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline double seconds() {
+	return double(nanoseconds()) / 1e9;
+}
+
+// The thread count to go up to, from the command line or the machine.
+inline unsigned max_threads(int argc, char** argv) {
+	if (argc > 1) {
+		int n = atoi(argv[1]);
+		if (n > 0)
+			return (unsigned) n;
+	}
+
+	unsigned n = iprog::thread::hardware_concurrency();
+	return n ? n : 1;
+}
+
+// 1, 2, 4, ... up to and including `max`.
+inline std::vector<unsigned> thread_counts(unsigned max) {
+	std::vector<unsigned> counts;
+	for (unsigned n = 1; n < max; n *= 2)
+		counts.push_back(n);
+	counts.push_back(max);
+	return counts;
+}
+
+// Runs body(index) on `count` threads, let go all at once, and returns how
+// many seconds it took until the last one was done.
+template<class F>
+double run_threads(unsigned count, F body) {
+	std::atomic<unsigned> ready{ 0 };
+	std::atomic<bool> go{ false };
+
+	std::vector<iprog::thread> threads;
+	for (unsigned i = 0; i < count; i++) {
+		threads.emplace_back([&, i]() {
+			ready.fetch_add(1);
+			while (!go.load())
+				iprog::this_thread::yield();
+			body(i);
+		});
+	}
+
+	while (ready.load() != count)
+		iprog::this_thread::yield();
+
+	double start = seconds();
+	go.store(true);
+	for (unsigned i = 0; i < count; i++)
+		threads[i].join();
+
+	return seconds() - start;
+}
+
+// Calls `measure`, which returns a time, a few times and keeps the best, so
+// that warming up the caches and the heap doesn't count.
+template<class F>
+double best_of(F measure, unsigned runs = 3) {
+	double best = measure();
+	for (unsigned i = 1; i < runs; i++) {
+		double time = measure();
+		if (time < best)
+			best = time;
+	}
+	return best;
+}
+
+// The sample that `fraction` of `sorted` are at or below.
+inline int64_t percentile(const std::vector<int64_t>& sorted, double fraction) {
+	if (sorted.empty())
+		return 0;
+
+	size_t index = size_t(fraction * double(sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+// A cheap per-thread random number generator, so that picking keys doesn't
+// get in the way of what is being measured.
+struct xorshift
+{
+	uint64_t m_state;
+
+	explicit xorshift(uint64_t seed) : m_state(seed * 0x9E3779B97F4A7C15ULL + 1) {}
+
+	uint64_t next() {
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 7;
+		m_state ^= m_state << 17;
+		return m_state;
+	}
+};
+
+} // namespace bench
+
+#endif//_IPROG_BENCH_
\ No newline at end of file
@@ -0,0 +1,97 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+// Operations per second on concurrent_hash_map against an unordered_map
+// behind one mutex, from 1 to N threads, at a few mixes of reads and writes.
+// Keys are picked at random from a fixed range that starts half full, and
+// writes alternate between inserting and erasing, so the maps stay about
+// that full and erased nodes keep being reclaimed.
+
+#include <unordered_map>
+
+#include <iprog/mutex.hpp>
+#include <iprog/lock_guard.hpp>
+#include <iprog/concurrent_hash_map.hpp>
+
+#include "bench.hpp"
+
+static const unsigned ops_per_thread = 200000;
+static const uint64_t key_range = 1 << 16;
+
+struct locked_map
+{
+	iprog::mutex m_mutex;
+	std::unordered_map<uint64_t, uint64_t> m_map;
+
+	bool find(uint64_t key, uint64_t& value) {
+		iprog::lock_guard<iprog::mutex> lg(m_mutex);
+		std::unordered_map<uint64_t, uint64_t>::iterator it = m_map.find(key);
+		if (it == m_map.end())
+			return false;
+		value = it->second;
+		return true;
+	}
+
+	void insert_or_assign(uint64_t key, uint64_t value) {
+		iprog::lock_guard<iprog::mutex> lg(m_mutex);
+		m_map[key] = value;
+	}
+
+	void erase(uint64_t key) {
+		iprog::lock_guard<iprog::mutex> lg(m_mutex);
+		m_map.erase(key);
+	}
+};
+
+// Runs the mix on `map` and returns operations per second.
+template<class Map>
+static double measure(Map& map, unsigned threads, unsigned read_percent)
+{
+	for (uint64_t key = 0; key < key_range; key += 2)
+		map.insert_or_assign(key, key);
+
+	double time = bench::run_threads(threads, [&](unsigned index) {
+		bench::xorshift rng(index + 1);
+		uint64_t value = 0, found = 0;
+		for (unsigned i = 0; i < ops_per_thread; i++) {
+			uint64_t r = rng.next();
+			uint64_t key = (r >> 8) % key_range;
+			if (r % 100 < read_percent)
+				found += map.find(key, value);
+			else if (i & 1)
+				map.insert_or_assign(key, key);
+			else
+				map.erase(key);
+		}
+
+		volatile uint64_t sink = found + value;
+		(void) sink;
+	});
+
+	return double(threads) * ops_per_thread / time;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned max = bench::max_threads(argc, argv);
+	static const unsigned read_percents[] = { 50, 90, 99 };
+
+	printf("%8s %8s %16s %16s %8s\n", "threads", "reads", "locked ops/s", "concurrent ops/s", "speedup");
+
+	for (unsigned threads : bench::thread_counts(max)) {
+		for (unsigned reads : read_percents) {
+			locked_map locked;
+			double locked_rate = measure(locked, threads, reads);
+
+			iprog::concurrent_hash_map<uint64_t, uint64_t> concurrent;
+			double concurrent_rate = measure(concurrent, threads, reads);
+
+			printf("%8u %7u%% %16.0f %16.0f %7.2fx\n", threads, reads, locked_rate, concurrent_rate, concurrent_rate / locked_rate);
+		}
+	}
+
+	return 0;
+}
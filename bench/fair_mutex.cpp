@@ -0,0 +1,79 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+// How long threads wait for a contended lock: mutex, which lets newcomers
+// barge in, against fair_mutex in strict FIFO mode and with a handoff forced
+// every millisecond.  Each thread takes the lock over and over, holds it for
+// a moment, and does a little work of its own in between.  The interesting
+// columns are the tail ones, which barging tends to blow up.
+
+#include <algorithm>
+
+#include <iprog/mutex.hpp>
+#include <iprog/fair_mutex.hpp>
+#include <iprog/lock_guard.hpp>
+
+#include "bench.hpp"
+
+static const unsigned ops_per_thread = 5000;
+
+// Enough that the lock is busy, without the work swamping the lock itself.
+static void spin(unsigned rounds, volatile uint64_t& sink)
+{
+	for (unsigned i = 0; i < rounds; i++)
+		sink = sink * 31 + i;
+}
+
+template<class Mutex>
+static void measure(const char* name, Mutex& mutex, unsigned threads)
+{
+	std::vector<std::vector<int64_t> > waits(threads);
+	volatile uint64_t shared = 0;
+
+	double time = bench::run_threads(threads, [&](unsigned index) {
+		std::vector<int64_t>& mine = waits[index];
+		mine.reserve(ops_per_thread);
+
+		volatile uint64_t local = index;
+		for (unsigned i = 0; i < ops_per_thread; i++) {
+			int64_t start = bench::nanoseconds();
+			iprog::lock_guard<Mutex> lg(mutex);
+			mine.push_back(bench::nanoseconds() - start);
+
+			spin(50, shared);
+			spin(200, local);
+		}
+	});
+
+	std::vector<int64_t> all;
+	for (unsigned i = 0; i < threads; i++)
+		all.insert(all.end(), waits[i].begin(), waits[i].end());
+	std::sort(all.begin(), all.end());
+
+	printf("%8u %-16s %12.0f %9.1f %9.1f %9.1f %9.1f\n", threads, name, double(all.size()) / time,
+		bench::percentile(all, 0.5) / 1e3, bench::percentile(all, 0.99) / 1e3,
+		bench::percentile(all, 0.999) / 1e3, all.back() / 1e3);
+}
+
+int main()
+{
+	static const unsigned thread_counts[] = { 8, 16, 32 };
+
+	printf("%8s %-16s %12s %9s %9s %9s %9s\n", "threads", "mutex", "ops/s", "p50 us", "p99 us", "p99.9 us", "max us");
+
+	for (unsigned threads : thread_counts) {
+		iprog::mutex barging;
+		measure("mutex", barging, threads);
+
+		iprog::fair_mutex fifo;
+		measure("fair_mutex", fifo, threads);
+
+		iprog::fair_mutex eventual(1000);
+		measure("fair_mutex(1ms)", eventual, threads);
+	}
+
+	return 0;
+}
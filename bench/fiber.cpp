@@ -0,0 +1,94 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+// Context switch latency.  First, two fibers on one worker yielding to each
+// other.  Then two fibers handing a turn back and forth through a
+// fiber_mutex and fiber_condition_variable, against two threads doing the
+// same through a mutex and condition_variable, which costs a trip through
+// the kernel every time.
+
+#include <iprog/fiber.hpp>
+#include <iprog/fiber_mutex.hpp>
+#include <iprog/mutex.hpp>
+#include <iprog/condition_variable.hpp>
+#include <iprog/unique_lock.hpp>
+
+#include "bench.hpp"
+
+static const unsigned yields = 1000000;
+static const unsigned handoffs = 100000;
+
+template<class Mutex, class ConditionVariable>
+struct turns
+{
+	Mutex m_mutex;
+	ConditionVariable m_cv;
+	unsigned m_turn = 0;
+
+	void play(unsigned player) {
+		for (unsigned i = 0; i < handoffs; i++) {
+			iprog::unique_lock<Mutex> lk(m_mutex);
+			while (m_turn != player)
+				m_cv.wait(lk);
+
+			m_turn = 1 - player;
+			m_cv.notify_one();
+		}
+	}
+};
+
+static void report(const char* name, double time, unsigned switches)
+{
+	printf("%-28s %12.0f %10.1f\n", name, switches / time, time * 1e9 / switches);
+}
+
+int main()
+{
+	printf("%-28s %12s %10s\n", "switch", "per second", "ns each");
+
+	iprog::fiber_scheduler scheduler(1);
+
+	double time = bench::best_of([&]() {
+		double start = bench::seconds();
+		iprog::fiber a(scheduler, []() {
+			for (unsigned i = 0; i < yields; i++)
+				iprog::this_fiber::yield();
+		});
+		iprog::fiber b(scheduler, []() {
+			for (unsigned i = 0; i < yields; i++)
+				iprog::this_fiber::yield();
+		});
+		a.join();
+		b.join();
+		return bench::seconds() - start;
+	});
+	report("fiber yield", time, 2 * yields);
+
+	time = bench::best_of([&]() {
+		turns<iprog::fiber_mutex, iprog::fiber_condition_variable> t;
+		double start = bench::seconds();
+		iprog::fiber a(scheduler, [&]() {
+			t.play(0);
+		});
+		iprog::fiber b(scheduler, [&]() {
+			t.play(1);
+		});
+		a.join();
+		b.join();
+		return bench::seconds() - start;
+	});
+	report("fiber condition variable", time, 2 * handoffs);
+
+	time = bench::best_of([&]() {
+		turns<iprog::mutex, iprog::condition_variable> t;
+		return bench::run_threads(2, [&](unsigned index) {
+			t.play(index);
+		});
+	});
+	report("thread condition variable", time, 2 * handoffs);
+
+	return 0;
+}
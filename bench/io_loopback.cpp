@@ -0,0 +1,177 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+// Round trips per second over loopback TCP, with the completions handled by
+// io_context on 1 to N threads.  A number of connections each bounce a small
+// message back and forth: the client side sends it, the server side echoes
+// it, and the client sends again once it's back.  Needs Winsock 2, so link
+// with -lws2_32.
+
+#include <iprog/io_context.hpp>
+
+#include "bench.hpp"
+
+#include <winsock2.h>
+
+static const unsigned connection_count = 32;
+static const unsigned round_trips = 2000;
+static const size_t message_size = 64;
+
+// One end of a connection, with the message it's sending or receiving.
+struct endpoint
+{
+	iprog::io_context* m_ctx;
+	SOCKET m_socket;
+	char m_buffer[message_size];
+	size_t m_filled;
+	bool m_client;
+
+	// Round trips left, on the client side.
+	unsigned m_left;
+};
+
+static void start_receive(endpoint* e);
+
+static void check(bool ok, const char* what)
+{
+	if (ok)
+		return;
+
+	printf("%s failed: %d\n", what, WSAGetLastError());
+	exit(1);
+}
+
+// Starts an overlapped send or receive of what's left of the message.
+template<class F>
+static void start(endpoint* e, bool send, F handler)
+{
+	iprog::io_operation* op = e->m_ctx->make_operation(handler);
+
+	WSABUF buf;
+	buf.buf = e->m_buffer + e->m_filled;
+	buf.len = ULONG(message_size - e->m_filled);
+
+	DWORD flags = 0;
+	int result = send
+		? WSASend(e->m_socket, &buf, 1, NULL, 0, (LPWSAOVERLAPPED) op->overlapped(), NULL)
+		: WSARecv(e->m_socket, &buf, 1, NULL, &flags, (LPWSAOVERLAPPED) op->overlapped(), NULL);
+
+	if (result == SOCKET_ERROR && WSAGetLastError() != WSA_IO_PENDING)
+		e->m_ctx->fail(op, std::error_code(WSAGetLastError(), std::system_category()));
+}
+
+static void start_send(endpoint* e)
+{
+	start(e, true, [e](const std::error_code& ec, size_t bytes) {
+		check(!ec, "WSASend");
+		e->m_filled += bytes;
+		if (e->m_filled < message_size) {
+			start_send(e);
+			return;
+		}
+
+		e->m_filled = 0;
+		start_receive(e);
+	});
+}
+
+static void start_receive(endpoint* e)
+{
+	start(e, false, [e](const std::error_code& ec, size_t bytes) {
+		// The client closing its end is how the server side finds out
+		// it's done.
+		if (!e->m_client && (ec || bytes == 0))
+			return;
+
+		check(!ec && bytes != 0, "WSARecv");
+		e->m_filled += bytes;
+		if (e->m_filled < message_size) {
+			start_receive(e);
+			return;
+		}
+
+		e->m_filled = 0;
+		if (e->m_client && --e->m_left == 0) {
+			closesocket(e->m_socket);
+			return;
+		}
+
+		start_send(e);
+	});
+}
+
+static void open_connection(iprog::io_context& ctx, SOCKET listener, const sockaddr_in& address, endpoint& client, endpoint& server)
+{
+	client.m_socket = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+	check(client.m_socket != INVALID_SOCKET, "WSASocket");
+	check(connect(client.m_socket, (const sockaddr*) &address, sizeof address) == 0, "connect");
+
+	// Sockets from accept() can do overlapped I/O if the listener can.
+	server.m_socket = accept(listener, NULL, NULL);
+	check(server.m_socket != INVALID_SOCKET, "accept");
+
+	// Small messages shouldn't sit waiting for more to send with them.
+	BOOL no_delay = TRUE;
+	setsockopt(client.m_socket, IPPROTO_TCP, TCP_NODELAY, (const char*) &no_delay, sizeof no_delay);
+	setsockopt(server.m_socket, IPPROTO_TCP, TCP_NODELAY, (const char*) &no_delay, sizeof no_delay);
+
+	ctx.register_handle((void*) client.m_socket);
+	ctx.register_handle((void*) server.m_socket);
+
+	client.m_ctx = server.m_ctx = &ctx;
+	client.m_filled = server.m_filled = 0;
+	client.m_client = true;
+	server.m_client = false;
+	client.m_left = round_trips;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned max = bench::max_threads(argc, argv);
+
+	WSADATA data;
+	check(WSAStartup(MAKEWORD(2, 2), &data) == 0, "WSAStartup");
+
+	SOCKET listener = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+	check(listener != INVALID_SOCKET, "WSASocket");
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+	check(bind(listener, (const sockaddr*) &address, sizeof address) == 0, "bind");
+	check(listen(listener, SOMAXCONN) == 0, "listen");
+
+	int length = sizeof address;
+	check(getsockname(listener, (sockaddr*) &address, &length) == 0, "getsockname");
+
+	printf("%8s %12s %16s\n", "threads", "connections", "round trips/s");
+
+	for (unsigned threads : bench::thread_counts(max)) {
+		iprog::io_context ctx(threads);
+		std::vector<endpoint> clients(connection_count), servers(connection_count);
+		for (unsigned i = 0; i < connection_count; i++)
+			open_connection(ctx, listener, address, clients[i], servers[i]);
+
+		for (unsigned i = 0; i < connection_count; i++) {
+			start_receive(&servers[i]);
+			start_send(&clients[i]);
+		}
+
+		double time = bench::run_threads(threads, [&](unsigned) {
+			ctx.run();
+		});
+
+		for (unsigned i = 0; i < connection_count; i++)
+			closesocket(servers[i].m_socket);
+
+		printf("%8u %12u %16.0f\n", threads, connection_count, double(connection_count) * round_trips / time);
+	}
+
+	closesocket(listener);
+	WSACleanup();
+	return 0;
+}
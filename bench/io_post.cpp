@@ -0,0 +1,60 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+// Handlers per second through io_context::post(), from 1 to N threads
+// calling run().  A number of chains run at once, and every handler posts
+// the next one in its chain, so each post has to wake a thread or be picked
+// up by one that's already awake, like completions in a busy server.
+
+#include <iprog/io_context.hpp>
+
+#include "bench.hpp"
+
+static const unsigned chain_count = 64;
+static const unsigned hops_per_chain = 20000;
+
+struct chain
+{
+	iprog::io_context* m_ctx;
+	unsigned m_left;
+};
+
+static void hop(chain* c)
+{
+	if (--c->m_left == 0)
+		return;
+
+	c->m_ctx->post([c]() {
+		hop(c);
+	});
+}
+
+int main(int argc, char** argv)
+{
+	unsigned max = bench::max_threads(argc, argv);
+
+	printf("%8s %16s\n", "threads", "handlers/s");
+
+	for (unsigned threads : bench::thread_counts(max)) {
+		double time = bench::best_of([&]() {
+			iprog::io_context ctx(threads);
+			std::vector<chain> chains(chain_count);
+			for (unsigned i = 0; i < chain_count; i++) {
+				chains[i].m_ctx = &ctx;
+				chains[i].m_left = hops_per_chain + 1;
+				hop(&chains[i]);
+			}
+
+			return bench::run_threads(threads, [&](unsigned) {
+				ctx.run();
+			});
+		});
+
+		printf("%8u %16.0f\n", threads, double(chain_count) * hops_per_chain / time);
+	}
+
+	return 0;
+}
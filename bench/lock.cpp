@@ -0,0 +1,118 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+// scoped_lock, which uses iprog::lock, against naive ordered locking: sort
+// the mutexes by address, then lock() them one after another.  Each operation
+// picks 2, 3 or 4 different mutexes out of a small pool at random, locks
+// them, bumps a counter behind each, and unlocks them.  With a small pool,
+// most operations collide with another thread's, so this shows how the back
+// off in iprog::lock holds up against simply waiting in a fixed order.
+
+#include <algorithm>
+#include <functional>
+
+#include <iprog/mutex.hpp>
+#include <iprog/scoped_lock.hpp>
+
+#include "bench.hpp"
+
+static const unsigned ops_per_thread = 100000;
+static const unsigned pool_size = 8;
+
+struct guarded
+{
+	iprog::mutex m_mutex;
+	uint64_t m_value = 0;
+};
+
+// Picks `count` different entries of `pool`, in no particular order.
+static void pick(guarded* pool, bench::xorshift& rng, unsigned count, guarded** out)
+{
+	for (unsigned i = 0; i < count; i++) {
+		for (;;) {
+			guarded* g = &pool[rng.next() % pool_size];
+			if (std::find(out, out + i, g) == out + i) {
+				out[i] = g;
+				break;
+			}
+		}
+	}
+}
+
+static void bump(guarded** g, unsigned count)
+{
+	for (unsigned i = 0; i < count; i++)
+		g[i]->m_value++;
+}
+
+static void with_scoped_lock(guarded** g, unsigned count)
+{
+	switch (count) {
+		case 2: {
+			iprog::scoped_lock<iprog::mutex, iprog::mutex> lk(g[0]->m_mutex, g[1]->m_mutex);
+			bump(g, count);
+			break;
+		}
+		case 3: {
+			iprog::scoped_lock<iprog::mutex, iprog::mutex, iprog::mutex> lk(g[0]->m_mutex, g[1]->m_mutex, g[2]->m_mutex);
+			bump(g, count);
+			break;
+		}
+		default: {
+			iprog::scoped_lock<iprog::mutex, iprog::mutex, iprog::mutex, iprog::mutex> lk(g[0]->m_mutex, g[1]->m_mutex, g[2]->m_mutex, g[3]->m_mutex);
+			bump(g, count);
+			break;
+		}
+	}
+}
+
+static void with_ordered_lock(guarded** g, unsigned count)
+{
+	std::sort(g, g + count, std::less<guarded*>());
+	for (unsigned i = 0; i < count; i++)
+		g[i]->m_mutex.lock();
+
+	bump(g, count);
+
+	for (unsigned i = count; i-- > 0; )
+		g[i]->m_mutex.unlock();
+}
+
+template<class F>
+static double measure(unsigned threads, unsigned count, F locked)
+{
+	guarded pool[pool_size];
+
+	double time = bench::best_of([&]() {
+		return bench::run_threads(threads, [&](unsigned index) {
+			bench::xorshift rng(index + 1);
+			guarded* g[4];
+			for (unsigned i = 0; i < ops_per_thread; i++) {
+				pick(pool, rng, count, g);
+				locked(g, count);
+			}
+		});
+	});
+
+	return double(threads) * ops_per_thread / time;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned max = bench::max_threads(argc, argv);
+
+	printf("%8s %8s %16s %16s %8s\n", "threads", "mutexes", "ordered ops/s", "scoped ops/s", "ratio");
+
+	for (unsigned threads : bench::thread_counts(max)) {
+		for (unsigned count = 2; count <= 4; count++) {
+			double ordered = measure(threads, count, &with_ordered_lock);
+			double scoped = measure(threads, count, &with_scoped_lock);
+			printf("%8u %8u %16.0f %16.0f %7.2fx\n", threads, count, ordered, scoped, scoped / ordered);
+		}
+	}
+
+	return 0;
+}
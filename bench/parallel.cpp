@@ -0,0 +1,98 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+// Speedup of parallel_for, parallel_reduce and parallel_sort over the same
+// work done serially.  The worker pool is sized once per process, so this
+// runs with the thread count it's given and prints one line per algorithm.
+// For the curve from 1 to N, run it once per count:
+//
+//     for %n in (1 2 4 8) do parallel.exe %n
+
+#include <algorithm>
+#include <cmath>
+
+#include <iprog/parallel.hpp>
+
+#include "bench.hpp"
+
+static const size_t element_count = 1 << 22;
+
+static double work(double x)
+{
+	return std::sqrt(x) * std::sin(x) + std::log(x + 1);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned threads = bench::max_threads(argc, argv);
+	iprog::set_parallel_concurrency(threads);
+
+	std::vector<double> in(element_count), out(element_count);
+	for (size_t i = 0; i < element_count; i++)
+		in[i] = double(i);
+
+	printf("%8s %-16s %12s %12s %8s\n", "threads", "algorithm", "serial ms", "parallel ms", "speedup");
+
+	double serial = bench::best_of([&]() {
+		double start = bench::seconds();
+		for (size_t i = 0; i < element_count; i++)
+			out[i] = work(in[i]);
+		return bench::seconds() - start;
+	});
+	double parallel = bench::best_of([&]() {
+		double start = bench::seconds();
+		iprog::parallel_for(0, element_count, [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; i++)
+				out[i] = work(in[i]);
+		});
+		return bench::seconds() - start;
+	});
+	printf("%8u %-16s %12.1f %12.1f %7.2fx\n", threads, "parallel_for", serial * 1e3, parallel * 1e3, serial / parallel);
+
+	volatile double sink = 0;
+	serial = bench::best_of([&]() {
+		double start = bench::seconds();
+		double sum = 0;
+		for (size_t i = 0; i < element_count; i++)
+			sum += work(in[i]);
+		sink = sum;
+		return bench::seconds() - start;
+	});
+	parallel = bench::best_of([&]() {
+		double start = bench::seconds();
+		sink = iprog::parallel_reduce(size_t(0), element_count, 0.0, [&](size_t lo, size_t hi) {
+			double sum = 0;
+			for (size_t i = lo; i < hi; i++)
+				sum += work(in[i]);
+			return sum;
+		}, [](double a, double b) {
+			return a + b;
+		});
+		return bench::seconds() - start;
+	});
+	printf("%8u %-16s %12.1f %12.1f %7.2fx\n", threads, "parallel_reduce", serial * 1e3, parallel * 1e3, serial / parallel);
+
+	std::vector<uint32_t> keys(element_count), sorted;
+	bench::xorshift rng(1);
+	for (size_t i = 0; i < element_count; i++)
+		keys[i] = uint32_t(rng.next());
+
+	serial = bench::best_of([&]() {
+		sorted = keys;
+		double start = bench::seconds();
+		std::sort(sorted.begin(), sorted.end());
+		return bench::seconds() - start;
+	});
+	parallel = bench::best_of([&]() {
+		sorted = keys;
+		double start = bench::seconds();
+		iprog::parallel_sort(sorted.begin(), sorted.end());
+		return bench::seconds() - start;
+	});
+	printf("%8u %-16s %12.1f %12.1f %7.2fx\n", threads, "parallel_sort", serial * 1e3, parallel * 1e3, serial / parallel);
+
+	return 0;
+}
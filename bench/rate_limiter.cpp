@@ -0,0 +1,107 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+// try_acquire() calls per second from 1 to N threads, each on a route of its
+// own, as in a client spreading requests over an API.  The limits are set
+// high enough that every call succeeds, so this measures the limiter and not
+// the limit.  It compares:
+//
+// - keyed_rate_limiter on its own,
+// - keyed_rate_limiter with a global limiter shared by every route,
+// - a token bucket per route plus a global one, all behind one mutex.
+
+#include <map>
+
+#include <iprog/mutex.hpp>
+#include <iprog/lock_guard.hpp>
+#include <iprog/rate_limiter.hpp>
+
+#include "bench.hpp"
+
+static const unsigned calls_per_thread = 500000;
+static const double rate = 1e9;
+static const double burst = 1e9;
+
+// The usual token bucket, refilled from the clock whenever it's looked at.
+struct bucket
+{
+	double m_tokens = burst;
+	int64_t m_last = bench::nanoseconds();
+
+	bool take(int64_t now) {
+		m_tokens += double(now - m_last) * rate / 1e9;
+		if (m_tokens > burst)
+			m_tokens = burst;
+		m_last = now;
+
+		if (m_tokens < 1)
+			return false;
+		m_tokens -= 1;
+		return true;
+	}
+};
+
+struct locked_limiter
+{
+	iprog::mutex m_mutex;
+	std::map<unsigned, bucket> m_routes;
+	bucket m_global;
+
+	bool try_acquire(unsigned route) {
+		iprog::lock_guard<iprog::mutex> lg(m_mutex);
+		int64_t now = bench::nanoseconds();
+		bucket& b = m_routes[route];
+		if (!b.take(now))
+			return false;
+
+		// Put the route's token back if the global limit says no.
+		if (!m_global.take(now)) {
+			b.m_tokens += 1;
+			return false;
+		}
+		return true;
+	}
+};
+
+template<class Limiter>
+static double measure(Limiter& limiter, unsigned threads)
+{
+	double time = bench::best_of([&]() {
+		return bench::run_threads(threads, [&](unsigned index) {
+			unsigned got = 0;
+			for (unsigned i = 0; i < calls_per_thread; i++)
+				got += limiter.try_acquire(index);
+
+			if (got != calls_per_thread)
+				printf("limited %u times!\n", calls_per_thread - got);
+		});
+	});
+
+	return double(threads) * calls_per_thread / time;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned max = bench::max_threads(argc, argv);
+
+	printf("%8s %16s %16s %16s\n", "threads", "keyed calls/s", "+global calls/s", "locked calls/s");
+
+	for (unsigned threads : bench::thread_counts(max)) {
+		iprog::keyed_rate_limiter<unsigned> keyed(rate, burst);
+		double keyed_rate = measure(keyed, threads);
+
+		iprog::rate_limiter global(rate, burst);
+		iprog::keyed_rate_limiter<unsigned> keyed_global(rate, burst, &global);
+		double global_rate = measure(keyed_global, threads);
+
+		locked_limiter locked;
+		double locked_rate = measure(locked, threads);
+
+		printf("%8u %16.0f %16.0f %16.0f\n", threads, keyed_rate, global_rate, locked_rate);
+	}
+
+	return 0;
+}
@@ -0,0 +1,58 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+// Increments per second on one counter shared by every thread, as a plain
+// std::atomic against a sharded_counter.  The atomic's cache line has to
+// move between cores on every increment, so it should fall behind as threads
+// are added, while the sharded counter keeps scaling.  The last column is
+// how long reading the sharded counter's total takes with that many slots.
+
+#include <iprog/per_thread.hpp>
+
+#include "bench.hpp"
+
+static const unsigned increments_per_thread = 2000000;
+
+int main(int argc, char** argv)
+{
+	unsigned max = bench::max_threads(argc, argv);
+
+	printf("%8s %16s %16s %8s %10s\n", "threads", "atomic incs/s", "sharded incs/s", "speedup", "value() ns");
+
+	for (unsigned threads : bench::thread_counts(max)) {
+		std::atomic<int64_t> atomic{ 0 };
+		double atomic_time = bench::best_of([&]() {
+			return bench::run_threads(threads, [&](unsigned) {
+				for (unsigned i = 0; i < increments_per_thread; i++)
+					atomic.fetch_add(1, std::memory_order_relaxed);
+			});
+		});
+
+		iprog::sharded_counter sharded;
+		double sharded_time = bench::best_of([&]() {
+			return bench::run_threads(threads, [&](unsigned) {
+				for (unsigned i = 0; i < increments_per_thread; i++)
+					sharded.increment();
+			});
+		});
+
+		static const unsigned reads = 10000;
+		int64_t start = bench::nanoseconds();
+		int64_t total = 0;
+		for (unsigned i = 0; i < reads; i++)
+			total += sharded.value();
+		double read_ns = double(bench::nanoseconds() - start) / reads;
+
+		// Three runs each.
+		if (total != int64_t(reads) * 3 * threads * increments_per_thread)
+			printf("wrong total!\n");
+
+		double count = double(threads) * increments_per_thread;
+		printf("%8u %16.0f %16.0f %7.2fx %10.1f\n", threads, count / atomic_time, count / sharded_time, atomic_time / sharded_time, read_ns);
+	}
+
+	return 0;
+}
@@ -0,0 +1,85 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+// How late each kind of sleep wakes up, and how much CPU it burns doing so,
+// at a few typical durations.  Overshoot is how long past the requested time
+// the sleep returned; CPU is the process's user and kernel time per sleep,
+// as a share of the time slept.
+
+#include <algorithm>
+
+#include <iprog/thread.hpp>
+
+#include "bench.hpp"
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+static const unsigned sleeps = 100;
+
+static int64_t cpu_nanoseconds()
+{
+	FILETIME created, exited, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+
+	uint64_t k = (uint64_t(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+	uint64_t u = (uint64_t(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+	return int64_t(k + u) * 100;
+}
+
+template<class F>
+static void measure(const char* name, std::chrono::microseconds duration, F sleep)
+{
+	std::vector<int64_t> overshoots;
+	overshoots.reserve(sleeps);
+
+	int64_t wanted = int64_t(duration.count()) * 1000;
+	int64_t cpu_start = cpu_nanoseconds();
+	int64_t wall_start = bench::nanoseconds();
+
+	for (unsigned i = 0; i < sleeps; i++) {
+		int64_t start = bench::nanoseconds();
+		sleep(duration);
+		overshoots.push_back(bench::nanoseconds() - start - wanted);
+	}
+
+	double cpu = double(cpu_nanoseconds() - cpu_start) / double(bench::nanoseconds() - wall_start);
+	std::sort(overshoots.begin(), overshoots.end());
+
+	printf("%8.1f %-22s %9.1f %9.1f %9.1f %7.1f%%\n", duration.count() / 1e3, name,
+		bench::percentile(overshoots, 0.5) / 1e3, bench::percentile(overshoots, 0.99) / 1e3,
+		overshoots.back() / 1e3, cpu * 100);
+}
+
+int main()
+{
+	using std::chrono::microseconds;
+	static const unsigned durations_us[] = { 1000, 2500, 5000, 16667 };
+
+	printf("%8s %-22s %9s %9s %9s %8s\n", "ms", "sleep", "p50 us", "p99 us", "max us", "cpu");
+
+	for (unsigned us : durations_us) {
+		microseconds duration(us);
+
+		measure("sleep_for", duration, [](microseconds d) {
+			iprog::this_thread::sleep_for(d);
+		});
+
+		measure("precise, no spin", duration, [](microseconds d) {
+			iprog::this_thread::sleep_for_precise(d, microseconds(0));
+		});
+
+		measure("precise, 500us spin", duration, [](microseconds d) {
+			iprog::this_thread::sleep_for_precise(d);
+		});
+
+		measure("coalescable, 4ms", duration, [](microseconds d) {
+			iprog::this_thread::sleep_for_coalescable(d, std::chrono::milliseconds(4));
+		});
+	}
+
+	return 0;
+}
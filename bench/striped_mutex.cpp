@@ -0,0 +1,68 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+// lock_table against one mutex guarding everything, at a range of key
+// counts.  Each operation locks a random key and bumps its counter.  With a
+// handful of keys the stripes collide about as much as the global lock, and
+// with many keys they should pull ahead as threads are added.
+
+#include <iprog/mutex.hpp>
+#include <iprog/lock_guard.hpp>
+#include <iprog/striped_mutex.hpp>
+
+#include "bench.hpp"
+
+static const unsigned ops_per_thread = 200000;
+
+// Padded, so that keys on different stripes don't share a cache line.
+struct counter
+{
+	uint64_t m_value;
+	char m_padding[56];
+};
+
+int main(int argc, char** argv)
+{
+	unsigned max = bench::max_threads(argc, argv);
+	static const unsigned key_counts[] = { 1, 8, 64, 1024, 65536 };
+
+	printf("%8s %8s %14s %14s %8s\n", "threads", "keys", "global ops/s", "striped ops/s", "speedup");
+
+	for (unsigned threads : bench::thread_counts(max)) {
+		for (unsigned keys : key_counts) {
+			std::vector<counter> counters(keys);
+
+			iprog::mutex global;
+			double global_time = bench::best_of([&]() {
+				return bench::run_threads(threads, [&](unsigned index) {
+					bench::xorshift rng(index + 1);
+					for (unsigned i = 0; i < ops_per_thread; i++) {
+						uint32_t key = (uint32_t) (rng.next() % keys);
+						iprog::lock_guard<iprog::mutex> lg(global);
+						counters[key].m_value++;
+					}
+				});
+			});
+
+			iprog::lock_table<uint32_t> table;
+			double striped_time = bench::best_of([&]() {
+				return bench::run_threads(threads, [&](unsigned index) {
+					bench::xorshift rng(index + 1);
+					for (unsigned i = 0; i < ops_per_thread; i++) {
+						uint32_t key = (uint32_t) (rng.next() % keys);
+						iprog::unique_lock<iprog::fair_mutex> lk = table.lock(key);
+						counters[key].m_value++;
+					}
+				});
+			});
+
+			double total = double(threads) * ops_per_thread;
+			printf("%8u %8u %14.0f %14.0f %7.2fx\n", threads, keys, total / global_time, total / striped_time, global_time / striped_time);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,60 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+// How long it takes to start a short-lived thread, with the OS thread cache
+// off and on.  Launch is from constructing the thread object until its
+// function starts running; round trip also includes the join.
+
+#include <algorithm>
+
+#include <iprog/thread.hpp>
+
+#include "bench.hpp"
+
+static const unsigned iterations = 2000;
+
+static void measure(const char* name, unsigned cache_limit)
+{
+	iprog::thread::set_cache_limit(cache_limit);
+
+	std::vector<int64_t> launches, round_trips;
+	launches.reserve(iterations);
+	round_trips.reserve(iterations);
+
+	// The first one fills the cache, if there is one.
+	for (unsigned i = 0; i <= iterations; i++) {
+		int64_t started = 0;
+		int64_t start = bench::nanoseconds();
+		iprog::thread t([&]() {
+			started = bench::nanoseconds();
+		});
+		t.join();
+		int64_t end = bench::nanoseconds();
+
+		if (i != 0) {
+			launches.push_back(started - start);
+			round_trips.push_back(end - start);
+		}
+	}
+
+	std::sort(launches.begin(), launches.end());
+	std::sort(round_trips.begin(), round_trips.end());
+
+	printf("%-10s %14.1f %14.1f %14.1f %14.1f\n", name,
+		bench::percentile(launches, 0.5) / 1e3, bench::percentile(launches, 0.99) / 1e3,
+		bench::percentile(round_trips, 0.5) / 1e3, bench::percentile(round_trips, 0.99) / 1e3);
+}
+
+int main()
+{
+	printf("%-10s %14s %14s %14s %14s\n", "cache", "launch p50 us", "launch p99 us", "round p50 us", "round p99 us");
+
+	measure("off", 0);
+	measure("on (8)", 8);
+
+	iprog::thread::set_cache_limit(0);
+	return 0;
+}
@@ -0,0 +1,66 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_ATOMIC_WAIT_
+#define _IPROG_ATOMIC_WAIT_
+
+#include <atomic>
+#include <chrono>
+
+#include "override_terminate.hpp"
+#include "w32constants.hpp"
+#include "parking_lot.hpp"
+
+// Blocking on the value of a std::atomic, like C++20's atomic::wait, built on
+// the parking lot.
+
+namespace iprog {
+
+// Blocks until the value at `address` is no longer `old`.  Only returns once
+// the value has been seen to change, so spurious wakeups are not visible.
+template<class T>
+void atomic_wait(const std::atomic<T>* address, T old, std::memory_order order = std::memory_order_seq_cst) {
+	while (address->load(order) == old) {
+		parking_lot::park(address, [&]() {
+			return address->load(std::memory_order_relaxed) == old;
+		});
+	}
+}
+
+// Like atomic_wait, but gives up after `rel_time`.  Returns true if the value
+// changed, false on timeout.
+template<class T, class Rep, class Per>
+bool atomic_wait_for(const std::atomic<T>* address, T old, const std::chrono::duration<Rep, Per>& rel_time,
+	std::memory_order order = std::memory_order_seq_cst) {
+	auto deadline = std::chrono::steady_clock::now() + rel_time;
+	while (address->load(order) == old) {
+		auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		if (left <= 0)
+			return false;
+
+		uint32_t timeout = left >= __infinite ? __infinite - 1 : uint32_t(left);
+		parking_lot::park_for(address, [&]() {
+			return address->load(std::memory_order_relaxed) == old;
+		}, timeout);
+	}
+	return true;
+}
+
+// Wakes one thread blocked in atomic_wait on `address`.
+template<class T>
+void atomic_notify_one(const std::atomic<T>* address) {
+	parking_lot::unpark_one(address);
+}
+
+// Wakes every thread blocked in atomic_wait on `address`.
+template<class T>
+void atomic_notify_all(const std::atomic<T>* address) {
+	parking_lot::unpark_all(address);
+}
+
+} // namespace iprog
+
+#endif//_IPROG_ATOMIC_WAIT_
\ No newline at end of file
@@ -0,0 +1,111 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_CHANNEL_
+#define _IPROG_CHANNEL_
+
+#include <cstddef>
+#include <deque>
+#include <utility>
+
+#include "fiber_mutex.hpp"
+
+// A bounded FIFO queue for passing values between fibers.  Pushing onto a
+// full channel, or popping from an empty one, sets aside the calling fiber
+// until there is room or a value.  Plain threads can use it too.
+
+namespace iprog {
+
+template<class T>
+class channel
+{
+public:
+	explicit channel(size_t capacity = 1) : m_capacity(capacity ? capacity : 1) {}
+
+	channel(const channel&) = delete;
+	channel& operator=(const channel&) = delete;
+
+	// Waits for room, then adds `value`.  Returns false, without adding it,
+	// if the channel is closed.
+	bool push(T value) {
+		unique_lock<fiber_mutex> lock(m_mutex);
+		while (!m_closed && m_items.size() >= m_capacity)
+			m_not_full.wait(lock);
+
+		if (m_closed)
+			return false;
+
+		m_items.push_back(std::move(value));
+		lock.unlock();
+		m_not_empty.notify_one();
+		return true;
+	}
+
+	// Waits for a value and moves it into `out`.  Returns false once the
+	// channel is closed and every value has been taken.
+	bool pop(T& out) {
+		unique_lock<fiber_mutex> lock(m_mutex);
+		while (!m_closed && m_items.empty())
+			m_not_empty.wait(lock);
+
+		return take(lock, out);
+	}
+
+	bool try_pop(T& out) {
+		unique_lock<fiber_mutex> lock(m_mutex);
+		return take(lock, out);
+	}
+
+	// Stops any more values from being pushed, and wakes everyone waiting.
+	// Values already in the channel can still be popped.
+	void close() {
+		{
+			unique_lock<fiber_mutex> lock(m_mutex);
+			m_closed = true;
+		}
+
+		m_not_full.notify_all();
+		m_not_empty.notify_all();
+	}
+
+	bool closed() const {
+		unique_lock<fiber_mutex> lock(m_mutex);
+		return m_closed;
+	}
+
+	size_t size() const {
+		unique_lock<fiber_mutex> lock(m_mutex);
+		return m_items.size();
+	}
+
+	size_t capacity() const noexcept {
+		return m_capacity;
+	}
+
+private:
+	bool take(unique_lock<fiber_mutex>& lock, T& out) {
+		if (m_items.empty())
+			return false;
+
+		out = std::move(m_items.front());
+		m_items.pop_front();
+		lock.unlock();
+		m_not_full.notify_one();
+		return true;
+	}
+
+	mutable fiber_mutex m_mutex;
+	fiber_condition_variable m_not_full;
+	fiber_condition_variable m_not_empty;
+
+	std::deque<T> m_items;
+	size_t m_capacity;
+	bool m_closed = false;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_CHANNEL_
\ No newline at end of file
@@ -0,0 +1,521 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_CONCURRENT_HASH_MAP_
+#define _IPROG_CONCURRENT_HASH_MAP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "override_terminate.hpp"
+#include "epoch.hpp"
+#include "fair_mutex.hpp"
+#include "lock_guard.hpp"
+#include "thread.hpp"
+
+// A hash map which can be read without taking any locks.
+//
+// It is an open addressing table of pointers to immutable nodes, probed
+// linearly.  Readers pin the epoch and follow the pointers.  Writers lock one
+// of a fixed set of stripes, picked by the key's hash, so writes to different
+// keys rarely wait for each other, and then swap whole nodes in and out.  A
+// node that has been replaced or erased is freed once no reader can still be
+// looking at it.
+//
+// Growing is incremental.  A new table is made next to the old one, and every
+// write moves a few slots across until the old one is empty, so no single
+// write ever has to copy the whole table.
+
+namespace iprog {
+
+template<class K, class V, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K> >
+class concurrent_hash_map
+{
+private:
+	struct node
+	{
+		node(uint64_t hash, const K& key, const V& value) : m_hash(hash), m_key(key), m_value(value) {}
+
+		const uint64_t m_hash;
+		const K m_key;
+		const V m_value;
+	};
+
+	struct table
+	{
+		explicit table(size_t capacity) : m_mask(capacity - 1), m_slots(new std::atomic<node*>[capacity]) {
+			for (size_t i = 0; i < capacity; i++)
+				m_slots[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		~table() {
+			delete[] m_slots;
+		}
+
+		size_t capacity() const noexcept {
+			return m_mask + 1;
+		}
+
+		const size_t m_mask;
+		std::atomic<node*>* const m_slots;
+
+		// Slots that have ever been taken from null, plus reservations for
+		// ones about to be.  Never goes down, since null slots never come back.
+		std::atomic<size_t> m_used{ 0 };
+
+		// The table this one is being moved into, if any.
+		std::atomic<table*> m_next{ nullptr };
+
+		// Where the next chunk to move starts, and how many slots are done.
+		std::atomic<size_t> m_migrate_cursor{ 0 };
+		std::atomic<size_t> m_migrated{ 0 };
+	};
+
+	enum class status {
+		done,
+		retry,      // ran into a slot that was moved, look at the tables again
+		need_space, // grow the table, or finish moving into the new one
+	};
+
+	static const size_t stripe_count = 64;
+	static const size_t min_capacity = 64;
+	static const size_t migrate_chunk = 16;
+
+public:
+	explicit concurrent_hash_map(size_t capacity = min_capacity, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual())
+		: m_hash(hash), m_equal(equal) {
+		size_t cap = min_capacity;
+		while (cap < capacity)
+			cap <<= 1;
+		m_table.store(new table(cap), std::memory_order_relaxed);
+	}
+
+	// Nobody may be using the map any more by the time this is destroyed.
+	~concurrent_hash_map() noexcept {
+		table* t = m_table.load(std::memory_order_relaxed);
+		table* next = t->m_next.load(std::memory_order_relaxed);
+		destroy_table(t);
+		if (next)
+			destroy_table(next);
+	}
+
+	concurrent_hash_map(const concurrent_hash_map&) = delete;
+	concurrent_hash_map& operator=(const concurrent_hash_map&) = delete;
+
+	// Calls f(const V&) with the value for `key`, if there is one, while the
+	// value is guaranteed to stay alive.  Doesn't lock anything.
+	template<class F>
+	bool visit(const K& key, F f) const {
+		uint64_t hash = hash_of(key);
+		epoch_guard pin;
+
+		const node* n = find_node(key, hash);
+		if (!n)
+			return false;
+
+		f(n->m_value);
+		return true;
+	}
+
+	// Copies the value for `key` to `out`.  Doesn't lock anything.
+	bool find(const K& key, V& out) const {
+		return visit(key, [&](const V& value) {
+			out = value;
+		});
+	}
+
+	bool contains(const K& key) const {
+		return visit(key, [](const V&) {});
+	}
+
+	// Adds `key` if it isn't there yet.  Returns whether it was added.
+	bool insert(const K& key, const V& value) {
+		return write(key, [&](table* target, uint64_t hash, size_t limit, bool& result) {
+			return do_insert(target, key, hash, limit, &value, false, result);
+		});
+	}
+
+	// Adds `key`, or replaces its value.  Returns whether it was added.
+	bool insert_or_assign(const K& key, const V& value) {
+		return write(key, [&](table* target, uint64_t hash, size_t limit, bool& result) {
+			return do_insert(target, key, hash, limit, &value, true, result);
+		});
+	}
+
+	// Replaces the value for `key` with a copy that f(V&) has modified.
+	// Returns false if there is no such key.
+	template<class F>
+	bool update(const K& key, F f) {
+		return write(key, [&](table* target, uint64_t hash, size_t, bool& result) {
+			size_t index;
+			bool hit_moved;
+			if (!locate(target, key, hash, index, hit_moved)) {
+				result = false;
+				return hit_moved ? status::retry : status::done;
+			}
+
+			node* old = target->m_slots[index].load(std::memory_order_relaxed);
+			V value(old->m_value);
+			f(value);
+			target->m_slots[index].store(new node(hash, key, value), std::memory_order_release);
+			epoch::retire(old);
+			result = true;
+			return status::done;
+		});
+	}
+
+	// Returns whether `key` was there.
+	bool erase(const K& key) {
+		return write(key, [&](table* target, uint64_t hash, size_t, bool& result) {
+			size_t index;
+			bool hit_moved;
+			if (!locate(target, key, hash, index, hit_moved)) {
+				result = false;
+				return hit_moved ? status::retry : status::done;
+			}
+
+			node* old = target->m_slots[index].load(std::memory_order_relaxed);
+			target->m_slots[index].store(tombstone(), std::memory_order_release);
+			epoch::retire(old);
+			m_size.fetch_sub(1, std::memory_order_relaxed);
+			result = true;
+			return status::done;
+		});
+	}
+
+	// Only exact while nobody is writing.
+	size_t size() const noexcept {
+		return m_size.load(std::memory_order_relaxed);
+	}
+
+	bool empty() const noexcept {
+		return size() == 0;
+	}
+
+private:
+	static node* tombstone() noexcept {
+		return reinterpret_cast<node*>(uintptr_t(1));
+	}
+
+	// A slot whose node or tombstone has been moved to the next table.
+	static node* moved() noexcept {
+		return reinterpret_cast<node*>(uintptr_t(2));
+	}
+
+	// A slot that was still null when the table was moved.  Like null, it
+	// ends a probe, since no key was ever placed past it.
+	static node* moved_empty() noexcept {
+		return reinterpret_cast<node*>(uintptr_t(3));
+	}
+
+	static bool is_node(const node* n) noexcept {
+		return uintptr_t(n) > 3;
+	}
+
+	// Mixes the hash, since std::hash is the identity for integers on most
+	// implementations.  The low bits pick the slot, the high ones the stripe.
+	uint64_t hash_of(const K& key) const {
+		uint64_t h = uint64_t(m_hash(key));
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	fair_mutex& stripe_for(uint64_t hash) const noexcept {
+		return m_stripes[size_t(hash >> 58) % stripe_count];
+	}
+
+	bool matches(const node* n, const K& key, uint64_t hash) const {
+		return n->m_hash == hash && m_equal(n->m_key, key);
+	}
+
+	// Looks through every table a reader could still need to, oldest first.
+	// A moved node doesn't end the search, since the key might still be
+	// further along in the old table.  If it was the key, it is in the next
+	// table by the time the slot says so.
+	const node* find_node(const K& key, uint64_t hash) const {
+		for (const table* t = m_table.load(std::memory_order_acquire); t; t = t->m_next.load(std::memory_order_acquire)) {
+			size_t index = size_t(hash) & t->m_mask;
+			for (size_t probes = 0; probes <= t->m_mask; probes++, index = (index + 1) & t->m_mask) {
+				const node* n = t->m_slots[index].load(std::memory_order_acquire);
+				if (!n || n == moved_empty())
+					break;
+				if (is_node(n) && matches(n, key, hash))
+					return n;
+			}
+		}
+		return nullptr;
+	}
+
+	// Finds the slot holding `key` in `t`.  Only for the holder of the key's
+	// stripe, since nobody else can move the key around.
+	bool locate(table* t, const K& key, uint64_t hash, size_t& index, bool& hit_moved) const {
+		hit_moved = false;
+		index = size_t(hash) & t->m_mask;
+		for (size_t probes = 0; probes <= t->m_mask; probes++, index = (index + 1) & t->m_mask) {
+			node* n = t->m_slots[index].load(std::memory_order_acquire);
+			if (!n)
+				return false;
+			if (n == moved_empty()) {
+				hit_moved = true;
+				return false;
+			}
+			if (n == moved())
+				hit_moved = true;
+			else if (is_node(n) && matches(n, key, hash))
+				return true;
+		}
+		return false;
+	}
+
+	// Puts a node from the old table into `t`.  The key can't be in `t` yet,
+	// and there is always room, since inserts into a table being filled stop
+	// well before it could run out.
+	void place(table* t, node* n) {
+		size_t index = size_t(n->m_hash) & t->m_mask;
+		for (size_t probes = 0; probes <= t->m_mask; probes++, index = (index + 1) & t->m_mask) {
+			node* s = t->m_slots[index].load(std::memory_order_relaxed);
+			if (s == tombstone()) {
+				if (t->m_slots[index].compare_exchange_strong(s, n, std::memory_order_release, std::memory_order_relaxed))
+					return;
+			}
+			else if (!s) {
+				t->m_used.fetch_add(1, std::memory_order_relaxed);
+				if (t->m_slots[index].compare_exchange_strong(s, n, std::memory_order_release, std::memory_order_relaxed))
+					return;
+				t->m_used.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+
+		terminateIprogsThreads();
+	}
+
+	// Moves `key` from `old` to `next`, if it is still in `old`.  The caller
+	// holds the key's stripe.
+	void migrate_key(table* old, table* next, const K& key, uint64_t hash) {
+		size_t index;
+		bool hit_moved;
+		if (!locate(old, key, hash, index, hit_moved))
+			return;
+
+		place(next, old->m_slots[index].load(std::memory_order_relaxed));
+		old->m_slots[index].store(moved(), std::memory_order_release);
+	}
+
+	void migrate_slot(table* old, table* next, size_t index) {
+		std::atomic<node*>& slot = old->m_slots[index];
+		for (;;) {
+			node* n = slot.load(std::memory_order_acquire);
+			if (n == moved() || n == moved_empty())
+				return;
+
+			if (!is_node(n)) {
+				if (slot.compare_exchange_strong(n, n ? moved() : moved_empty(), std::memory_order_release, std::memory_order_relaxed))
+					return;
+				continue;
+			}
+
+			// Only the holder of the key's stripe may move a live node.
+			lock_guard<fair_mutex> lg(stripe_for(n->m_hash));
+			node* again = slot.load(std::memory_order_acquire);
+			if (again == n) {
+				place(next, n);
+				slot.store(moved(), std::memory_order_release);
+				return;
+			}
+		}
+	}
+
+	// Moves a chunk of `old` into `next`, or all that is left if `all` is
+	// set.  Must not be called while holding a stripe.
+	void help_migrate(table* old, table* next, bool all) {
+		size_t capacity = old->capacity();
+		do {
+			size_t start = old->m_migrate_cursor.fetch_add(migrate_chunk, std::memory_order_relaxed);
+			if (start >= capacity)
+				break;
+
+			size_t end = start + migrate_chunk < capacity ? start + migrate_chunk : capacity;
+			for (size_t i = start; i < end; i++)
+				migrate_slot(old, next, i);
+
+			// Whoever finishes the last chunk retires the old table.
+			size_t done = old->m_migrated.fetch_add(end - start, std::memory_order_acq_rel) + (end - start);
+			if (done == capacity) {
+				m_table.store(next, std::memory_order_release);
+				epoch::retire(old);
+			}
+		} while (all);
+
+		// Someone else may still be finishing a chunk.
+		if (all) {
+			while (m_table.load(std::memory_order_acquire) == old)
+				this_thread::yield();
+		}
+	}
+
+	// Starts moving `t` into a new table.  It doubles unless most of what is
+	// taking up space is tombstones, in which case the new table is the same
+	// size, which clears them out.
+	void start_resize(table* t) {
+		size_t capacity = t->capacity();
+		if (m_size.load(std::memory_order_relaxed) >= capacity / 4)
+			capacity *= 2;
+
+		table* next = new table(capacity);
+		table* expected = nullptr;
+		if (!t->m_next.compare_exchange_strong(expected, next, std::memory_order_acq_rel, std::memory_order_acquire))
+			delete next;
+	}
+
+	// Runs `op` on the table the key belongs in, under the key's stripe, and
+	// deals with growing.
+	template<class Op>
+	bool write(const K& key, Op op) {
+		uint64_t hash = hash_of(key);
+		epoch_guard pin;
+
+		for (;;) {
+			table* t = m_table.load(std::memory_order_acquire);
+			table* next = t->m_next.load(std::memory_order_acquire);
+			if (next)
+				help_migrate(t, next, false);
+
+			bool result = false;
+			status st;
+			{
+				lock_guard<fair_mutex> lg(stripe_for(hash));
+				table* target = t;
+				size_t limit = t->capacity() / 4 * 3;
+				if (next) {
+					// While `next` is being filled, leave room in it for
+					// everything that could still come over from `t`.
+					migrate_key(t, next, key, hash);
+					target = next;
+
+					size_t incoming = t->m_used.load(std::memory_order_relaxed);
+					if (incoming < t->capacity() / 4 * 3)
+						incoming = t->capacity() / 4 * 3;
+
+					size_t room = next->capacity() / 8 * 7;
+					limit = room > incoming ? room - incoming : 0;
+				}
+
+				st = op(target, hash, limit, result);
+			}
+
+			if (st == status::done)
+				return result;
+
+			if (st == status::need_space) {
+				if (next)
+					help_migrate(t, next, true);
+				else
+					start_resize(t);
+			}
+		}
+	}
+
+	status do_insert(table* target, const K& key, uint64_t hash, size_t limit, const V* value, bool assign, bool& result) {
+		size_t index = size_t(hash) & target->m_mask;
+		size_t free_index = 0;
+		bool have_free = false;
+
+		// Look for the key, and for the first slot it could go in.
+		size_t probes = 0;
+		for (; probes <= target->m_mask; probes++, index = (index + 1) & target->m_mask) {
+			node* n = target->m_slots[index].load(std::memory_order_acquire);
+			if (n == moved() || n == moved_empty())
+				return status::retry;
+
+			if (!n) {
+				if (!have_free) {
+					free_index = index;
+					have_free = true;
+				}
+				break;
+			}
+
+			if (n == tombstone()) {
+				if (!have_free) {
+					free_index = index;
+					have_free = true;
+				}
+				continue;
+			}
+
+			if (!matches(n, key, hash))
+				continue;
+
+			result = false;
+			if (assign) {
+				target->m_slots[index].store(new node(hash, key, *value), std::memory_order_release);
+				epoch::retire(n);
+			}
+			return status::done;
+		}
+
+		if (!have_free)
+			return status::need_space;
+
+		std::unique_ptr<node> fresh(new node(hash, key, *value));
+		node* expected = target->m_slots[free_index].load(std::memory_order_relaxed);
+		if (expected == tombstone()) {
+			if (!target->m_slots[free_index].compare_exchange_strong(expected, fresh.get(), std::memory_order_release, std::memory_order_relaxed))
+				return status::retry;
+		}
+		else if (!expected) {
+			if (target->m_used.fetch_add(1, std::memory_order_relaxed) >= limit) {
+				target->m_used.fetch_sub(1, std::memory_order_relaxed);
+				return status::need_space;
+			}
+
+			if (!target->m_slots[free_index].compare_exchange_strong(expected, fresh.get(), std::memory_order_release, std::memory_order_relaxed)) {
+				target->m_used.fetch_sub(1, std::memory_order_relaxed);
+				return status::retry;
+			}
+		}
+		else {
+			return status::retry;
+		}
+
+		fresh.release();
+		m_size.fetch_add(1, std::memory_order_relaxed);
+		result = true;
+		return status::done;
+	}
+
+	static void destroy_table(table* t) noexcept {
+		for (size_t i = 0; i <= t->m_mask; i++) {
+			node* n = t->m_slots[i].load(std::memory_order_relaxed);
+			if (is_node(n))
+				delete n;
+		}
+		delete t;
+	}
+
+private:
+	std::atomic<table*> m_table;
+
+	std::atomic<size_t> m_size{ 0 };
+
+	mutable fair_mutex m_stripes[stripe_count];
+
+	Hash m_hash;
+
+	KeyEqual m_equal;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_CONCURRENT_HASH_MAP_
\ No newline at end of file
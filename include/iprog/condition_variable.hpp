@@ -15,6 +15,8 @@
 #include "mutex.hpp"
 #include "unique_lock.hpp"
 #include "lock_guard.hpp"
+#include "stop_token.hpp"
+#include "trace.hpp"
 
 // Thanks to https://github.com/meganz/mingw-std-threads for the help implementing this!
 
@@ -25,18 +27,16 @@ enum class cv_status {
 	timeout,
 };
 
+// Waiters park on a single word, which every notify bumps, so that a waiter
+// which has unlocked but not yet parked can't miss a notification.  That can
+// also wake a waiter that didn't need waking, which is allowed.
 class condition_variable_any
 {
-private:
-	typedef void* native_handle;
-
 public:
-	condition_variable_any();
+	condition_variable_any() noexcept {}
 
 	condition_variable_any(const condition_variable_any&) = delete;
 
-	~condition_variable_any();
-
 	condition_variable_any& operator=(const condition_variable_any&) = delete;
 
 	template<class M>
@@ -50,44 +50,14 @@ public:
 			wait(lock);
 	}
 
-	void notify_all() noexcept {
-		lock_guard<recursive_mutex> lg(m_mutex);
-		if (m_num_waiters.load() < 0)
-			return;
-
-		release_sem(m_semaphore, m_num_waiters, nullptr);
-		
-		while (m_num_waiters > 0) {
-			auto ret = wait_object(m_wake_event, 1000);
-			if (ret == __wait_failed || ret == __wait_abandoned)
-				terminateIprogsThreads();
-		}
-		if (m_num_waiters != 0)
-			terminateIprogsThreads();
-
-		// In case some of the waiters timed out just after we released the
-		// semaphore by m_num_waiters, it won't be zero now, because not all
-		// the waiters woke up by acquiring the semaphore.  So we must zero
-		// the semaphore before we accept waiters for the next event.
-		while (wait_object(m_semaphore, 0) == __wait_object_0);
-	}
+	void notify_all() noexcept;
 
-	void notify_one() noexcept {
-		notify_some(1);
-	}
+	void notify_one() noexcept;
 
 	template<class M, class Rep, class Per>
 	cv_status wait_for(M& lock, const std::chrono::duration<Rep, Per>& rel_time) {
 		auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(rel_time).count();
-		uint32_t wait_time;
-		if (timeout >= __infinite)
-			wait_time = __infinite - 1;
-		else if (timeout < 0)
-			wait_time = 0;
-		else
-			wait_time = static_cast<uint32_t>(timeout);
-
-		bool ret = wait_impl(lock, wait_time) || (timeout >= __infinite);
+		bool ret = wait_impl(lock, to_wait_time(rel_time)) || (timeout >= __infinite);
 		return ret ? cv_status::no_timeout : cv_status::timeout;
 	}
 
@@ -109,68 +79,99 @@ public:
 		return true;
 	}
 
-private:
-	template<class M>
-	bool wait_impl(M& lock, uint32_t timeout) {
-		m_mutex.lock();
-		m_num_waiters++;
-		m_mutex.unlock();
-		lock.unlock();
+	// Interruptible waits.  These return as soon as a stop is requested on
+	// `stoken`, without waiting for a notification, and return pred().
+	template<class M, class Pred>
+	bool wait(M& lock, stop_token stoken, Pred pred) {
+		if (stoken.stop_requested())
+			return pred();
 
-		uint32_t ret = wait_object(m_semaphore, timeout);
-		m_num_waiters--;
-		set_event(m_wake_event);
-		lock.lock();
+		stop_callback<stop_notifier> cb(stoken, stop_notifier(this));
+		while (!stoken.stop_requested()) {
+			if (pred())
+				return true;
+			wait_impl(lock, __infinite, &stoken);
+		}
+		return pred();
+	}
 
-		if (ret == __wait_object_0)
-			return true;
-		if (ret == __wait_timeout)
-			return false;
+	template<class M, class Clock, class Duration, class Pred>
+	bool wait_until(M& lock, stop_token stoken, const std::chrono::time_point<Clock, Duration>& abs_time, Pred pred) {
+		if (stoken.stop_requested())
+			return pred();
+
+		stop_callback<stop_notifier> cb(stoken, stop_notifier(this));
+		while (!stoken.stop_requested()) {
+			if (pred())
+				return true;
+
+			auto rel_time = abs_time - Clock::now();
+			if (rel_time <= rel_time.zero())
+				break;
 
-		// 2 possible cases.
-		// 1) The point in notify_all() where we determine the count to increment
-		//    the semaphore by has not been reached yet, we just need to decrement
-		//    m_num_waiters, but setting the event doesn't hurt
-		// 2) Semaphore has just been released with m_num_waiters just before we
-		//    decremented it.  This means that the semaphore count after all wait-
-		//    ers finish won't be zero - because not all waiters woke up by acqui-
-		//    ring the semaphore - we woke up by a timeout.	The notify_all() must
-		//    handle this gracefully.
-
-		throw std::system_error(std::make_error_code(std::errc::function_not_supported));
-	}
-
-	void notify_some(int count) noexcept {
-		lock_guard<recursive_mutex> lg(m_mutex);
-		int target_waiters = m_num_waiters - count;
-		if (target_waiters < 0)
-			return;
-
-		release_sem(m_semaphore, count, nullptr);
-		while (m_num_waiters > target_waiters) {
-			auto ret = wait_object(m_wake_event, 1000);
-			if (ret == __wait_failed || ret == __wait_abandoned)
-				terminateIprogsThreads();
+			wait_impl(lock, to_wait_time(rel_time), &stoken);
 		}
+		return pred();
+	}
 
-		if (m_num_waiters != target_waiters)
-			terminateIprogsThreads();
+	template<class M, class Rep, class Per, class Pred>
+	bool wait_for(M& lock, stop_token stoken, const std::chrono::duration<Rep, Per>& rel_time, Pred pred) {
+		return wait_until(lock, std::move(stoken), std::chrono::steady_clock::now() + rel_time, pred);
 	}
 
-	uint32_t wait_object(native_handle sem, uint32_t timeout);
+private:
+	// Wakes up every waiter when a stop is requested on an interruptible wait.
+	struct stop_notifier
+	{
+		explicit stop_notifier(condition_variable_any* cv) noexcept : m_cv(cv) {}
 
-	bool set_event(native_handle ev);
+		void operator()() const noexcept {
+			m_cv->notify_all();
+		}
 
-	bool release_sem(native_handle sem, long count, long* prev_count);
+		condition_variable_any* m_cv;
+	};
 
-private:
-	recursive_mutex m_mutex;
+	template<class Rep, class Per>
+	static uint32_t to_wait_time(const std::chrono::duration<Rep, Per>& rel_time) {
+		auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(rel_time).count();
+		if (timeout >= __infinite)
+			return __infinite - 1;
+		if (timeout < 0)
+			return 0;
+		return static_cast<uint32_t>(timeout);
+	}
 
-	std::atomic<long> m_num_waiters { 0 };
+	template<class M>
+	bool wait_impl(M& lock, uint32_t timeout, const stop_token* stoken = nullptr) {
+		// Read before checking for a stop, so a stop_notifier either bumps
+		// the signal after this or we see its stop request here.
+		uint32_t seen = m_signal.load(std::memory_order_seq_cst);
+		if (stoken && stoken->stop_requested())
+			return false;
 
-	native_handle m_semaphore = nullptr;
+		trace::record(trace_event::cv_wait, this);
+		lock.unlock();
 
-	native_handle m_wake_event = nullptr;
+		bool notified;
+		try {
+			notified = wait_signal(seen, timeout);
+		}
+		catch (...) {
+			lock.lock();
+			throw;
+		}
+
+		trace::record(trace_event::cv_wake, this, notified ? 0 : 1);
+		lock.lock();
+		return notified;
+	}
+
+	// Parks until the signal moves on from `seen`.  Returns false on timeout.
+	bool wait_signal(uint32_t seen, uint32_t timeout);
+
+private:
+	std::atomic<uint32_t> m_signal{ 0 };
 };
 
 class condition_variable : public condition_variable_any
@@ -0,0 +1,73 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_EPOCH_
+#define _IPROG_EPOCH_
+
+#include "override_terminate.hpp"
+
+// Epoch-based memory reclamation.  Readers pin the current epoch while they
+// look at shared objects; writers retire objects they have unlinked, and a
+// retired object is freed once every thread that was pinned when it was
+// retired has unpinned again.  Pinning is a plain store and a fence, with no
+// locks and no read-modify-write.
+
+namespace iprog {
+
+class epoch
+{
+public:
+	// Pins the calling thread.  Pins nest.  Prefer epoch_guard.
+	static void enter();
+
+	// Unpins the calling thread, when the outermost pin is released.
+	static void leave() noexcept;
+
+	// Check whether the calling thread is pinned.
+	static bool is_pinned() noexcept;
+
+	// Hands `object` over to be freed with `deleter` once no pinned thread
+	// can still be looking at it.  The object must already be unreachable
+	// for threads that pin from now on.
+	static void retire(void* object, void (*deleter)(void*));
+
+	template<class T>
+	static void retire(T* object) {
+		retire(object, &delete_object<T>);
+	}
+
+	// Tries to advance the epoch, and frees whatever has become safe to free.
+	// This also happens on its own as objects are retired.
+	static void collect();
+
+	// Blocks until everything retired so far by the calling thread has been
+	// freed.  Must not be called while pinned.
+	static void synchronize();
+
+private:
+	template<class T>
+	static void delete_object(void* object) {
+		delete static_cast<T*>(object);
+	}
+};
+
+// Pins the calling thread for the lifetime of the guard.
+class epoch_guard
+{
+public:
+	epoch_guard() {
+		epoch::enter();
+	}
+	~epoch_guard() noexcept {
+		epoch::leave();
+	}
+	epoch_guard(const epoch_guard&) = delete;
+	epoch_guard& operator=(const epoch_guard&) = delete;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_EPOCH_
\ No newline at end of file
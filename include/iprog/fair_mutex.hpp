@@ -0,0 +1,87 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_FAIR_MUTEX_
+#define _IPROG_FAIR_MUTEX_
+
+#include <atomic>
+#include <cstdint>
+
+#include "override_terminate.hpp"
+
+// A small mutex built on the parking lot, which hands ownership straight to
+// the longest waiting thread on unlock instead of letting newcomers barge in
+// ahead of it.  The lock itself is one byte, which is all the fast paths
+// touch; the rest of the object is only used when there are waiters.
+
+namespace iprog {
+
+class fair_mutex
+{
+public:
+	// With `handoff_after_us` zero, every contended unlock hands the mutex to
+	// the longest waiter (strict FIFO).  Otherwise, unlock lets waiters and
+	// newcomers race for it, but forces a handoff to the longest waiter if
+	// none has happened for that many microseconds.  The clock runs from the
+	// last handoff, not from when the oldest waiter started waiting, so a
+	// waiter can wait up to about that long for each waiter ahead of it.
+	explicit fair_mutex(uint32_t handoff_after_us = 0) noexcept : m_handoff_us(handoff_after_us) {}
+
+	fair_mutex(const fair_mutex&) = delete;
+
+	fair_mutex& operator=(const fair_mutex&) = delete;
+
+	void lock() {
+		uint8_t expected = 0;
+		if (m_state.compare_exchange_weak(expected, locked_bit, std::memory_order_acquire, std::memory_order_relaxed))
+			return;
+
+		lock_slow();
+	}
+
+	bool try_lock() noexcept {
+		uint8_t state = m_state.load(std::memory_order_relaxed);
+		while (!(state & locked_bit)) {
+			if (m_state.compare_exchange_weak(state, state | locked_bit, std::memory_order_acquire, std::memory_order_relaxed))
+				return true;
+		}
+		return false;
+	}
+
+	void unlock() {
+		uint8_t expected = locked_bit;
+		if (m_state.compare_exchange_weak(expected, 0, std::memory_order_release, std::memory_order_relaxed))
+			return;
+
+		unlock_slow();
+	}
+
+	// Check whether this mutex is held by anyone.  Only useful as a hint.
+	bool is_locked() const noexcept {
+		return (m_state.load(std::memory_order_relaxed) & locked_bit) != 0;
+	}
+
+private:
+	void lock_slow();
+
+	void unlock_slow();
+
+	static const uint8_t locked_bit = 1;
+	static const uint8_t parked_bit = 2;
+
+private:
+	std::atomic<uint8_t> m_state{ 0 };
+
+	uint32_t m_handoff_us;
+
+	// When the next forced handoff is due, in performance counter ticks.
+	// Only touched from unlock_slow, under the parking lot's bucket lock.
+	int64_t m_next_handoff = 0;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_FAIR_MUTEX_
\ No newline at end of file
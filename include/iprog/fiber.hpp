@@ -0,0 +1,271 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_FIBER_
+#define _IPROG_FIBER_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <utility>
+
+#include "override_terminate.hpp"
+#include "fair_mutex.hpp"
+
+// Fibers are functions with their own stack that a small set of worker
+// threads take turns running, switching between them in user mode.  A fiber
+// that blocks on a fiber_mutex, fiber_condition_variable, channel, or a
+// join(), is set aside, and its worker moves on to another fiber, instead of
+// the whole thread blocking.  So it takes a lot less than a thread per task
+// to write blocking style code.
+//
+// Each worker has its own queue of ready fibers.  A new fiber goes to
+// whichever worker is free first, and from then on, it only ever runs on
+// that one.  So thread_local values and thread IDs stay the same across a
+// switch.  The price is that fibers are only balanced between workers when
+// they start: a fiber that runs for long without blocking holds up the
+// others on its worker, even when other workers are idle.
+//
+// Blocking on anything that isn't fiber-aware, such as an iprog::mutex,
+// holds up the whole worker for as long as it blocks.
+//
+// Locks that aren't fiber-aware must not be held across a fiber switch,
+// that is, across any call that can block on a fiber primitive or yield.
+// They belong to the worker thread, not the fiber, so another fiber on the
+// same worker would be taken for the owner, or would block the worker while
+// the fiber that holds the lock waits behind it.  Use a fiber_mutex instead.
+
+namespace iprog {
+
+class fiber_scheduler;
+
+namespace detail {
+
+// Defined in fiber.cpp.
+struct fiber_context;
+struct fiber_scheduler_state;
+
+class fiber_function
+{
+public:
+	fiber_function(const fiber_function&) = delete;
+	fiber_function& operator=(const fiber_function&) = delete;
+
+	// Anything thrown out of the function ends the process, like it does
+	// for threads.
+	void run() noexcept {
+		m_complete(this, true);
+	}
+
+	void discard() noexcept {
+		m_complete(this, false);
+	}
+
+protected:
+	// Called with `call` false to free the function without calling it.
+	typedef void (*complete_function)(fiber_function* fn, bool call);
+
+	explicit fiber_function(complete_function complete) noexcept : m_complete(complete) {}
+
+	~fiber_function() {}
+
+private:
+	complete_function m_complete;
+};
+
+template<class F>
+class fiber_handler_function : public fiber_function
+{
+public:
+	explicit fiber_handler_function(F&& f) : fiber_function(&complete), m_f(std::move(f)) {}
+
+private:
+	static void complete(fiber_function* base, bool call) {
+		fiber_handler_function* self = static_cast<fiber_handler_function*>(base);
+		F f(std::move(self->m_f));
+		delete self;
+
+		if (call)
+			f();
+	}
+
+	F m_f;
+};
+
+// A fiber, or a plain thread, waiting on one of the fiber primitives.
+struct fiber_waiter
+{
+	// Null if a plain thread is waiting.
+	fiber_context* m_fiber = nullptr;
+
+	// Only used by plain threads.
+	std::atomic<uint32_t> m_woken{ 0 };
+
+	fiber_waiter* m_next = nullptr;
+};
+
+struct fiber_wait_list
+{
+	fiber_waiter* m_head = nullptr;
+	fiber_waiter* m_tail = nullptr;
+
+	bool empty() const noexcept {
+		return m_head == nullptr;
+	}
+
+	void push(fiber_waiter* waiter) noexcept {
+		waiter->m_next = nullptr;
+		if (m_tail)
+			m_tail->m_next = waiter;
+		else
+			m_head = waiter;
+		m_tail = waiter;
+	}
+
+	fiber_waiter* pop() noexcept {
+		fiber_waiter* waiter = m_head;
+		if (waiter) {
+			m_head = waiter->m_next;
+			if (!m_head)
+				m_tail = nullptr;
+		}
+		return waiter;
+	}
+};
+
+// Sets up `waiter` for whoever is calling, fiber or not.
+void fiber_prepare_wait(fiber_waiter& waiter) noexcept;
+
+// Releases `guard`, which protects the list `waiter` has been put on, and
+// waits until someone takes it off the list and calls fiber_wake() on it.
+// A fiber only lets go of `guard` once it has been switched out, so it can't
+// be woken before it is done going to sleep.
+void fiber_wait(fiber_waiter& waiter, fair_mutex& guard);
+
+// `waiter` may be gone as soon as this has been called.
+void fiber_wake(fiber_waiter& waiter) noexcept;
+
+fiber_context* fiber_spawn(fiber_scheduler_state* scheduler, fiber_function* fn);
+
+void fiber_join(fiber_context* context);
+
+void fiber_release(fiber_context* context) noexcept;
+
+} // namespace detail
+
+// A set of worker threads that run fibers.
+class fiber_scheduler
+{
+public:
+	// How much address space each fiber's stack reserves, unless told
+	// otherwise.  Small enough for tens of thousands of fibers in a 32-bit
+	// process.  Only a page or so of it is committed up front.
+	static const size_t default_stack_size = 64 * 1024;
+
+	// `workers` zero means one per processor.  `stack_size` is how much each
+	// fiber's stack reserves, and zero means default_stack_size.
+	//
+	// Before Windows XP, the stack reservation can't be made smaller than
+	// what the executable asks for (1 MiB unless linked otherwise), so a
+	// 32-bit process runs out of address space after a thousand or so
+	// fibers.  There, `stack_size` only sets how much is committed, and zero
+	// means the executable's default.
+	explicit fiber_scheduler(unsigned workers = 0, size_t stack_size = 0);
+
+	// Waits for every fiber to finish, then stops the workers.  Must not be
+	// called from one of them.
+	~fiber_scheduler();
+
+	fiber_scheduler(const fiber_scheduler&) = delete;
+	fiber_scheduler& operator=(const fiber_scheduler&) = delete;
+
+	unsigned worker_count() const noexcept;
+
+private:
+	friend class fiber;
+
+	detail::fiber_scheduler_state* m_state;
+};
+
+// Owns a running fiber, like thread owns a running thread.
+class fiber
+{
+public:
+	fiber() noexcept : m_context(nullptr) {}
+
+	// Starts running f() on `scheduler`.
+	template<class F>
+	fiber(fiber_scheduler& scheduler, F f) {
+		m_context = detail::fiber_spawn(scheduler.m_state, new detail::fiber_handler_function<F>(std::move(f)));
+	}
+
+	fiber(fiber&& other) noexcept : m_context(other.m_context) {
+		other.m_context = nullptr;
+	}
+
+	fiber& operator=(fiber&& other) noexcept {
+		if (joinable())
+			terminateIprogsThreads();
+
+		m_context = other.m_context;
+		other.m_context = nullptr;
+		return *this;
+	}
+
+	fiber(const fiber&) = delete;
+	fiber& operator=(const fiber&) = delete;
+
+	~fiber() {
+		if (joinable())
+			terminateIprogsThreads();
+	}
+
+	bool joinable() const noexcept {
+		return m_context != nullptr;
+	}
+
+	// Waits for the fiber to finish.  Only sets aside the caller if it's a
+	// fiber itself.
+	void join() {
+		if (!joinable())
+			throw std::system_error(std::make_error_code(std::errc::invalid_argument));
+
+		detail::fiber_join(m_context);
+		detail::fiber_release(m_context);
+		m_context = nullptr;
+	}
+
+	void detach() {
+		if (!joinable())
+			throw std::system_error(std::make_error_code(std::errc::invalid_argument));
+
+		detail::fiber_release(m_context);
+		m_context = nullptr;
+	}
+
+	void swap(fiber& other) noexcept {
+		std::swap(m_context, other.m_context);
+	}
+
+private:
+	detail::fiber_context* m_context;
+};
+
+class this_fiber
+{
+public:
+	// Lets the other fibers that are ready run first.  On a plain thread,
+	// this is this_thread::yield().
+	static void yield();
+
+	// Check whether the caller is a fiber.
+	static bool is_fiber() noexcept;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_FIBER_
\ No newline at end of file
@@ -0,0 +1,69 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_FIBER_MUTEX_
+#define _IPROG_FIBER_MUTEX_
+
+#include "fiber.hpp"
+#include "unique_lock.hpp"
+
+// A mutex and condition variable for fibers.  Waiting on them sets aside the
+// waiting fiber and lets its worker run others.  Plain threads can use them
+// too, and simply block.
+
+namespace iprog {
+
+// Unlocking hands the mutex straight to the longest waiter, if there is one.
+class fiber_mutex
+{
+public:
+	fiber_mutex() noexcept {}
+
+	fiber_mutex(const fiber_mutex&) = delete;
+	fiber_mutex& operator=(const fiber_mutex&) = delete;
+
+	void lock();
+
+	bool try_lock() noexcept;
+
+	void unlock();
+
+private:
+	// Protects the rest.  Only ever held briefly.
+	fair_mutex m_guard;
+
+	bool m_locked = false;
+	detail::fiber_wait_list m_waiters;
+};
+
+class fiber_condition_variable
+{
+public:
+	fiber_condition_variable() noexcept {}
+
+	fiber_condition_variable(const fiber_condition_variable&) = delete;
+	fiber_condition_variable& operator=(const fiber_condition_variable&) = delete;
+
+	void wait(unique_lock<fiber_mutex>& lock);
+
+	template<class Predicate>
+	void wait(unique_lock<fiber_mutex>& lock, Predicate pred) {
+		while (!pred())
+			wait(lock);
+	}
+
+	void notify_one() noexcept;
+
+	void notify_all() noexcept;
+
+private:
+	fair_mutex m_guard;
+	detail::fiber_wait_list m_waiters;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_FIBER_MUTEX_
\ No newline at end of file
@@ -0,0 +1,676 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_FLOW_GRAPH_
+#define _IPROG_FLOW_GRAPH_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <map>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "override_terminate.hpp"
+#include "fair_mutex.hpp"
+#include "lock_guard.hpp"
+#include "parking_lot.hpp"
+#include "per_thread.hpp"
+#include "thread.hpp"
+
+// A pipeline of stages connected by bounded buffers.  Each node calls its
+// function on the items coming into it, on as many threads as it is given,
+// and passes the results on to the node it is connected to.  A full buffer
+// makes the node feeding it wait, so a slow stage holds back the ones before
+// it, instead of letting items pile up in memory.
+//
+// Nodes are added and connected, then the graph is started.  Items go in
+// through push() on the nodes nothing feeds into, which are closed once
+// there are no more.  Every node finishes once its input is closed and
+// drained, and closes the input of the node after it.  wait() returns once
+// all of them have finished.
+//
+// If a node's function throws, the graph is cancelled: every buffer drops
+// what it holds, and wait() rethrows the first exception.
+
+namespace iprog {
+
+class flow_graph;
+
+template<class In, class Out>
+class flow_node;
+
+enum class flow_order {
+	unordered,
+	// Results leave in the order the items came in, even with several
+	// threads.  Finished results wait for the ones before them, and threads
+	// don't take items more than the node's capacity past the oldest one
+	// still waiting to be sent.
+	ordered,
+};
+
+struct flow_node_options
+{
+	// Threads calling the node's function.
+	unsigned concurrency = 1;
+
+	// Items the node's input holds before whoever feeds it has to wait.
+	size_t capacity = 64;
+
+	// The most items a thread takes off the input, or passes on, at once.
+	// Bigger batches take the locks less often.
+	size_t batch_size = 1;
+
+	flow_order order = flow_order::unordered;
+};
+
+struct flow_stats
+{
+	uint64_t processed;
+
+	size_t queue_depth;
+	size_t max_queue_depth;
+
+	// Since the graph was started, until the node finished.
+	double items_per_second;
+};
+
+namespace detail {
+
+// A bounded FIFO queue.  Items are numbered as they come in.
+template<class T>
+class flow_buffer
+{
+public:
+	typedef std::pair<uint64_t, T> entry;
+
+	explicit flow_buffer(size_t capacity) : m_capacity(capacity ? capacity : 1) {}
+
+	flow_buffer(const flow_buffer&) = delete;
+	flow_buffer& operator=(const flow_buffer&) = delete;
+
+	// Moves all of `items` in, waiting for room as needed.  Returns false if
+	// the buffer was aborted or closed first.
+	bool push(std::vector<T>& items) {
+		size_t i = 0;
+		bool waited = false;
+		while (i < items.size()) {
+			m_mutex.lock();
+			if (waited)
+				m_push_waiters--;
+
+			if (m_aborted || m_closed) {
+				m_mutex.unlock();
+				return false;
+			}
+
+			size_t before = i;
+			while (i < items.size() && m_items.size() < m_capacity) {
+				m_items.push_back(entry(m_next_seq, std::move(items[i])));
+				m_next_seq++;
+				i++;
+			}
+
+			bool wake = false;
+			if (i != before) {
+				if (m_items.size() > m_max_depth)
+					m_max_depth = m_items.size();
+				m_items_signal.fetch_add(1);
+				wake = m_pop_waiters != 0;
+			}
+
+			uint32_t seen = m_space_signal.load();
+			waited = i < items.size();
+			if (waited)
+				m_push_waiters++;
+			m_mutex.unlock();
+
+			if (wake)
+				parking_lot::unpark_all(&m_items_signal);
+
+			if (waited) {
+				parking_lot::park(&m_space_signal, [this, seen]() {
+					return m_space_signal.load() == seen;
+				});
+			}
+		}
+
+		return true;
+	}
+
+	// Waits for at least one item, then moves up to `max` into `out`.
+	// Returns false once the buffer is closed and empty, or aborted.
+	bool pop(std::vector<entry>& out, size_t max) {
+		bool waited = false;
+		for (;;) {
+			m_mutex.lock();
+			if (waited)
+				m_pop_waiters--;
+
+			if (m_aborted) {
+				m_mutex.unlock();
+				return false;
+			}
+
+			if (!m_items.empty()) {
+				while (!m_items.empty() && out.size() < max) {
+					out.push_back(std::move(m_items.front()));
+					m_items.pop_front();
+				}
+
+				m_space_signal.fetch_add(1);
+				bool wake = m_push_waiters != 0;
+				m_mutex.unlock();
+
+				if (wake)
+					parking_lot::unpark_all(&m_space_signal);
+				return true;
+			}
+
+			if (m_closed) {
+				m_mutex.unlock();
+				return false;
+			}
+
+			uint32_t seen = m_items_signal.load();
+			m_pop_waiters++;
+			waited = true;
+			m_mutex.unlock();
+
+			parking_lot::park(&m_items_signal, [this, seen]() {
+				return m_items_signal.load() == seen;
+			});
+		}
+	}
+
+	// No more items will come.  The ones in here can still be popped.
+	void close() {
+		finish(false);
+	}
+
+	// Drops everything, and makes every push and pop fail from now on.
+	void abort() {
+		finish(true);
+	}
+
+	size_t depth(size_t* max_depth) {
+		lock_guard<fair_mutex> lg(m_mutex);
+		if (max_depth)
+			*max_depth = m_max_depth;
+		return m_items.size();
+	}
+
+private:
+	void finish(bool abort) {
+		std::deque<entry> dropped;
+		{
+			lock_guard<fair_mutex> lg(m_mutex);
+			m_closed = true;
+			if (abort) {
+				m_aborted = true;
+				dropped.swap(m_items);
+			}
+			m_items_signal.fetch_add(1);
+			m_space_signal.fetch_add(1);
+		}
+
+		parking_lot::unpark_all(&m_items_signal);
+		parking_lot::unpark_all(&m_space_signal);
+	}
+
+	fair_mutex m_mutex;
+	std::deque<entry> m_items;
+	size_t m_capacity;
+	size_t m_max_depth = 0;
+	uint64_t m_next_seq = 0;
+	bool m_closed = false;
+	bool m_aborted = false;
+
+	// Bumped when items come in, or room is made, so that waiters can tell
+	// whether they missed it.
+	std::atomic<uint32_t> m_items_signal{ 0 };
+	std::atomic<uint32_t> m_space_signal{ 0 };
+	unsigned m_pop_waiters = 0;
+	unsigned m_push_waiters = 0;
+};
+
+// The part of a node that doesn't depend on its types.  It runs the node's
+// threads and keeps track of when it's done.
+class flow_node_base
+{
+public:
+	flow_node_base(const flow_node_base&) = delete;
+	flow_node_base& operator=(const flow_node_base&) = delete;
+
+	const std::string& name() const noexcept {
+		return m_name;
+	}
+
+	flow_stats stats();
+
+protected:
+	typedef void (*node_function)(flow_node_base* node);
+	typedef size_t (*depth_function)(flow_node_base* node, size_t* max_depth);
+
+	flow_node_base(flow_graph& graph, const char* name, const flow_node_options& options) :
+		m_graph(&graph), m_name(name ? name : ""), m_options(options) {
+		if (m_options.concurrency == 0)
+			m_options.concurrency = 1;
+		if (m_options.batch_size == 0)
+			m_options.batch_size = 1;
+	}
+
+	~flow_node_base() {}
+
+	// One of the inputs, either a node feeding this one or the outside,
+	// has no more items.  The last one closes our buffer.
+	void input_finished();
+
+	// Records items that went through the node's function.
+	void count_processed(size_t count) {
+		m_processed.add((int64_t) count);
+	}
+
+	flow_graph* m_graph;
+	std::string m_name;
+	flow_node_options m_options;
+
+	flow_node_base* m_successor = nullptr;
+	unsigned m_predecessors = 0;
+
+	// Starts at one for the outside, which connecting the first node in
+	// front of this one takes over.
+	std::atomic<unsigned> m_open_inputs{ 1 };
+
+	std::atomic<bool> m_closed_outside{ false };
+
+	// Threads still running the node.
+	std::atomic<unsigned> m_running{ 0 };
+
+	sharded_counter m_processed;
+
+	// In performance counter ticks.  Finished is zero until the last thread
+	// is done.
+	int64_t m_started_ticks = 0;
+	std::atomic<int64_t> m_finished_ticks{ 0 };
+
+	std::vector<thread> m_workers;
+
+	// Set by the typed node.
+	node_function m_run = nullptr;
+	node_function m_close = nullptr;
+	node_function m_abort = nullptr;
+	node_function m_destroy = nullptr;
+	depth_function m_depth = nullptr;
+
+	friend class iprog::flow_graph;
+
+	friend void flow_worker_main(flow_node_base* node);
+};
+
+void flow_worker_main(flow_node_base* node);
+
+// A node, as far as the nodes feeding it are concerned.
+template<class T>
+class flow_input : public flow_node_base
+{
+public:
+	// Feeds an item into a node that no other node feeds into, waiting if
+	// its input is full.  Returns false if the graph was cancelled, or the
+	// input closed.
+	bool push(T item) {
+		if (m_predecessors != 0)
+			throw std::system_error(std::make_error_code(std::errc::operation_not_permitted));
+
+		std::vector<T> items;
+		items.push_back(std::move(item));
+		return m_input.push(items);
+	}
+
+	// Says no more items will be pushed.
+	void close() {
+		if (m_predecessors != 0)
+			throw std::system_error(std::make_error_code(std::errc::operation_not_permitted));
+
+		if (!m_closed_outside.exchange(true))
+			input_finished();
+	}
+
+protected:
+	flow_input(flow_graph& graph, const char* name, const flow_node_options& options) :
+		flow_node_base(graph, name, options), m_input(options.capacity) {
+		m_close = &close_input;
+		m_abort = &abort_input;
+		m_depth = &input_depth;
+	}
+
+	~flow_input() {}
+
+	static void close_input(flow_node_base* base) {
+		static_cast<flow_input*>(base)->m_input.close();
+	}
+
+	static void abort_input(flow_node_base* base) {
+		static_cast<flow_input*>(base)->m_input.abort();
+	}
+
+	static size_t input_depth(flow_node_base* base, size_t* max_depth) {
+		return static_cast<flow_input*>(base)->m_input.depth(max_depth);
+	}
+
+	flow_buffer<T> m_input;
+
+	template<class, class>
+	friend class iprog::flow_node;
+
+	friend class iprog::flow_graph;
+};
+
+} // namespace detail
+
+// A node taking In and producing Out.  Out can be void for a node that ends
+// the pipeline.
+template<class In, class Out>
+class flow_node : public detail::flow_input<In>
+{
+protected:
+	typedef detail::flow_input<In> input_type;
+	typedef typename detail::flow_buffer<In>::entry entry;
+
+	typedef Out (*call_function)(flow_node* node, In& item);
+
+	flow_node(flow_graph& graph, const char* name, const flow_node_options& options, call_function call) :
+		input_type(graph, name, options), m_call(call), m_window(options.capacity ? options.capacity : 1) {
+		this->m_run = &run;
+		this->m_abort = &abort_node;
+	}
+
+	~flow_node() {}
+
+private:
+	static void run(detail::flow_node_base* base) {
+		flow_node* self = static_cast<flow_node*>(base);
+		bool ordered = self->m_options.order == flow_order::ordered && self->m_options.concurrency > 1;
+
+		std::vector<entry> batch;
+		std::vector<Out> results;
+		for (;;) {
+			size_t max = self->m_options.batch_size;
+			if (ordered) {
+				max = self->take_window(max);
+				if (max == 0)
+					return;
+			}
+
+			bool popped = self->m_input.pop(batch, max);
+			if (ordered && batch.size() < max)
+				self->give_window(max - batch.size());
+
+			if (!popped)
+				return;
+
+			for (size_t i = 0; i < batch.size(); i++)
+				results.push_back(self->m_call(self, batch[i].second));
+
+			self->count_processed(batch.size());
+
+			bool sent = ordered ? self->send_in_order(batch, results) : self->send(results);
+			if (!sent)
+				return;
+
+			batch.clear();
+			results.clear();
+		}
+	}
+
+	bool send(std::vector<Out>& results) {
+		if (!m_next)
+			return true;
+
+		return m_next->m_input.push(results);
+	}
+
+	// Holds on to results until every one before them has been sent.  The
+	// lock is held while sending, so that they go out in that order.
+	bool send_in_order(const std::vector<entry>& batch, std::vector<Out>& results) {
+		lock_guard<fair_mutex> lg(m_order_mutex);
+		for (size_t i = 0; i < batch.size(); i++)
+			m_waiting.insert(std::make_pair(batch[i].first, std::move(results[i])));
+
+		results.clear();
+		typename std::map<uint64_t, Out>::iterator it = m_waiting.begin();
+		while (it != m_waiting.end() && it->first == m_next_to_send) {
+			results.push_back(std::move(it->second));
+			m_waiting.erase(it++);
+			m_next_to_send++;
+		}
+
+		if (!results.empty())
+			give_window(results.size());
+
+		return send(results);
+	}
+
+	// Waits for room in the window of items taken but not yet sent, and
+	// takes up to `max` of it.  Returns 0 if the graph was cancelled.
+	//
+	// Items come off the input in order, so this keeps every one taken, and
+	// every one in m_waiting, within the capacity of m_next_to_send.
+	size_t take_window(size_t max) {
+		bool waited = false;
+		for (;;) {
+			m_window_mutex.lock();
+			if (waited)
+				m_window_waiters--;
+
+			if (m_window_aborted) {
+				m_window_mutex.unlock();
+				return 0;
+			}
+
+			if (m_window != 0) {
+				size_t taken = max < m_window ? max : m_window;
+				m_window -= taken;
+				m_window_mutex.unlock();
+				return taken;
+			}
+
+			uint32_t seen = m_window_signal.load();
+			m_window_waiters++;
+			waited = true;
+			m_window_mutex.unlock();
+
+			parking_lot::park(&m_window_signal, [this, seen]() {
+				return m_window_signal.load() == seen;
+			});
+		}
+	}
+
+	void give_window(size_t count) {
+		m_window_mutex.lock();
+		m_window += count;
+		m_window_signal.fetch_add(1);
+		bool wake = m_window_waiters != 0;
+		m_window_mutex.unlock();
+
+		if (wake)
+			parking_lot::unpark_all(&m_window_signal);
+	}
+
+	// Results waiting on one that will never come can't make room, so
+	// cancelling has to wake whoever is waiting for it.
+	static void abort_node(detail::flow_node_base* base) {
+		flow_node* self = static_cast<flow_node*>(base);
+		input_type::abort_input(base);
+
+		self->m_window_mutex.lock();
+		self->m_window_aborted = true;
+		self->m_window_signal.fetch_add(1);
+		self->m_window_mutex.unlock();
+
+		parking_lot::unpark_all(&self->m_window_signal);
+	}
+
+	call_function m_call;
+
+	detail::flow_input<Out>* m_next = nullptr;
+
+	fair_mutex m_order_mutex;
+	std::map<uint64_t, Out> m_waiting;
+	uint64_t m_next_to_send = 0;
+
+	// Only used when ordered.  Room left in the window, and a signal bumped when
+	// it grows, like the ones in flow_buffer.
+	fair_mutex m_window_mutex;
+	size_t m_window;
+	bool m_window_aborted = false;
+	std::atomic<uint32_t> m_window_signal{ 0 };
+	unsigned m_window_waiters = 0;
+
+	friend class flow_graph;
+};
+
+template<class In>
+class flow_node<In, void> : public detail::flow_input<In>
+{
+protected:
+	typedef detail::flow_input<In> input_type;
+	typedef typename detail::flow_buffer<In>::entry entry;
+
+	typedef void (*call_function)(flow_node* node, In& item);
+
+	// Nothing comes after this node, so there is nothing to keep in order.
+	// With one thread, items are handled in the order they come in anyway.
+	flow_node(flow_graph& graph, const char* name, const flow_node_options& options, call_function call) :
+		input_type(graph, name, options), m_call(call) {
+		this->m_run = &run;
+	}
+
+	~flow_node() {}
+
+private:
+	static void run(detail::flow_node_base* base) {
+		flow_node* self = static_cast<flow_node*>(base);
+
+		std::vector<entry> batch;
+		while (self->m_input.pop(batch, self->m_options.batch_size)) {
+			for (size_t i = 0; i < batch.size(); i++)
+				self->m_call(self, batch[i].second);
+
+			self->count_processed(batch.size());
+			batch.clear();
+		}
+	}
+
+	call_function m_call;
+
+	friend class flow_graph;
+};
+
+namespace detail {
+
+template<class In, class Out, class F>
+class flow_node_impl : public flow_node<In, Out>
+{
+public:
+	flow_node_impl(flow_graph& graph, const char* name, const flow_node_options& options, F&& body) :
+		flow_node<In, Out>(graph, name, options, &call), m_body(std::move(body)) {
+		this->m_destroy = &destroy;
+	}
+
+private:
+	static Out call(flow_node<In, Out>* base, In& item) {
+		return static_cast<flow_node_impl*>(base)->m_body(item);
+	}
+
+	static void destroy(flow_node_base* base) {
+		delete static_cast<flow_node_impl*>(base);
+	}
+
+	F m_body;
+};
+
+} // namespace detail
+
+class flow_graph
+{
+public:
+	flow_graph() noexcept {}
+
+	// Cancels the graph if it's still running, and waits for it.
+	~flow_graph();
+
+	flow_graph(const flow_graph&) = delete;
+	flow_graph& operator=(const flow_graph&) = delete;
+
+	// Adds a node calling body(In&), which returns an Out.  It belongs to the
+	// graph from then on.
+	template<class In, class Out, class F>
+	flow_node<In, Out>& add_node(const char* name, F body, const flow_node_options& options = flow_node_options()) {
+		if (m_started)
+			throw std::system_error(std::make_error_code(std::errc::operation_not_permitted));
+
+		detail::flow_node_impl<In, Out, F>* node = new detail::flow_node_impl<In, Out, F>(*this, name, options, std::move(body));
+		add(node);
+		return *node;
+	}
+
+	// Sends what `from` produces to `to`.  Several nodes can feed into one,
+	// but each sends to only one.
+	template<class In, class T, class Out>
+	void connect(flow_node<In, T>& from, flow_node<T, Out>& to) {
+		if (m_started || from.m_graph != this || to.m_graph != this)
+			throw std::system_error(std::make_error_code(std::errc::operation_not_permitted));
+		if (from.m_successor)
+			throw std::system_error(std::make_error_code(std::errc::invalid_argument));
+
+		from.m_successor = &to;
+		from.m_next = &to;
+		if (to.m_predecessors++ != 0)
+			to.m_open_inputs.fetch_add(1);
+	}
+
+	// Starts every node's threads.
+	void start();
+
+	// Waits for every node to finish, and rethrows the first exception one
+	// of them threw.
+	void wait();
+
+	// Stops every node as soon as it can, dropping the items in between.
+	void cancel() noexcept;
+
+	bool cancelled() const noexcept {
+		return m_cancelled.load();
+	}
+
+private:
+	friend void detail::flow_worker_main(detail::flow_node_base* node);
+
+	void add(detail::flow_node_base* node);
+
+	void fail(std::exception_ptr error) noexcept;
+
+	void join_all() noexcept;
+
+	std::vector<detail::flow_node_base*> m_nodes;
+	bool m_started = false;
+
+	std::atomic<bool> m_cancelled{ false };
+
+	// Set by the first node to fail, which alone then writes m_error.  It's
+	// only read once every node's threads are joined.
+	std::atomic<bool> m_failed{ false };
+	std::exception_ptr m_error;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_FLOW_GRAPH_
\ No newline at end of file
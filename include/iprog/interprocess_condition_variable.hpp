@@ -0,0 +1,170 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_INTERPROCESS_CONDITION_VARIABLE_
+#define _IPROG_INTERPROCESS_CONDITION_VARIABLE_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "interprocess_mutex.hpp"
+#include "condition_variable.hpp"
+#include "unique_lock.hpp"
+#include "ticks.hpp"
+
+// A condition variable for interprocess_mutex, which can live in shared
+// memory the same way.  Notifying with nobody waiting is a plain atomic
+// operation.
+//
+// Waiters sleep on the semaphore until woken or timed out, with no periodic
+// checks.  Every notify starts a new generation, and a wakeup may only be
+// kept by a waiter from an earlier one, so notify_one wakes exactly one of
+// the threads that were waiting when it was called.  A later waiter that
+// gets it by mistake hands it back, and lets the ones it is for go first.
+//
+// Each process with waiters has a slot, holding its process ID and how many
+// of its threads are waiting, the way interprocess_mutex records its owner.
+// When a waiter gets a wakeup it can't keep, it first writes off the waiters
+// of any process that has died.  A wakeup that was meant for those is then
+// taken off the count, and its semaphore count is dropped by whichever
+// waiter gets it, instead of being handed on.  Up to max_waiting_processes
+// processes can wait at once; waiting from one more throws
+// resource_unavailable_try_again.
+
+namespace iprog {
+
+class interprocess_condition_variable
+{
+public:
+	static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "interprocess_condition_variable needs lock free 64-bit atomics");
+
+	// How many processes can have threads waiting at the same time.
+	static const size_t max_waiting_processes = 16;
+
+	interprocess_condition_variable() noexcept;
+
+	// Only closes this process's handle to the semaphore.
+	~interprocess_condition_variable() noexcept;
+
+	interprocess_condition_variable(const interprocess_condition_variable&) = delete;
+	interprocess_condition_variable& operator=(const interprocess_condition_variable&) = delete;
+
+	void wait(unique_lock<interprocess_mutex>& lock) {
+		wait_impl(lock, -1);
+	}
+
+	template<class Predicate>
+	void wait(unique_lock<interprocess_mutex>& lock, Predicate pred) {
+		while (!pred())
+			wait(lock);
+	}
+
+	template<class Rep, class Per>
+	cv_status wait_for(unique_lock<interprocess_mutex>& lock, const std::chrono::duration<Rep, Per>& rel_time) {
+		return wait_impl(lock, detail::to_nanoseconds(rel_time));
+	}
+
+	template<class Rep, class Per, class Pred>
+	bool wait_for(unique_lock<interprocess_mutex>& lock, const std::chrono::duration<Rep, Per>& rel_time, Pred pred) {
+		return wait_until(lock, std::chrono::steady_clock::now() + rel_time, pred);
+	}
+
+	template<class Clock, class Duration>
+	cv_status wait_until(unique_lock<interprocess_mutex>& lock, const std::chrono::time_point<Clock, Duration>& abs_time) {
+		return wait_for(lock, abs_time - Clock::now());
+	}
+
+	template<class Clock, class Duration, class Pred>
+	bool wait_until(unique_lock<interprocess_mutex>& lock, const std::chrono::time_point<Clock, Duration>& abs_time, Pred pred) {
+		while (!pred())
+			if (wait_until(lock, abs_time) == cv_status::timeout)
+				return pred();
+		return true;
+	}
+
+	void notify_one();
+
+	void notify_all();
+
+private:
+	// m_state holds, from the bottom, the waiters that came since the last
+	// notify, the waiters from before it, the wakeups given out to those and
+	// not yet taken, and the generation.
+	static const uint64_t one_new_waiter = 1;
+	static const uint64_t one_old_waiter = one_new_waiter << 14;
+	static const uint64_t one_wakeup = one_old_waiter << 14;
+	static const uint64_t one_generation = one_wakeup << 14;
+	static const uint64_t count_mask = one_old_waiter - 1;
+
+	static uint64_t new_waiters_of(uint64_t state) noexcept {
+		return state & count_mask;
+	}
+
+	static uint64_t old_waiters_of(uint64_t state) noexcept {
+		return (state / one_old_waiter) & count_mask;
+	}
+
+	static uint64_t wakeups_of(uint64_t state) noexcept {
+		return (state / one_wakeup) & count_mask;
+	}
+
+	static uint64_t generation_of(uint64_t state) noexcept {
+		return state / one_generation;
+	}
+
+	// A slot's m_waiters holds, from the bottom, the generation its newest
+	// waiter came in, how many came in that one, and how many before.
+	static const uint64_t generation_mask = (uint64_t(1) << 22) - 1;
+	static const uint64_t slot_one_new = generation_mask + 1;
+	static const uint64_t slot_one_old = slot_one_new << 21;
+	static const uint64_t slot_count_mask = (uint64_t(1) << 21) - 1;
+
+	struct waiting_process
+	{
+		std::atomic<uint32_t> m_pid;
+		std::atomic<uint64_t> m_waiters;
+	};
+
+	// `ns` negative means no timeout.
+	cv_status wait_impl(unique_lock<interprocess_mutex>& lock, int64_t ns);
+
+	// Counts the caller as a waiter, in m_state and in its process's slot.
+	// Returns the slot, and the generation it came in.
+	size_t add_waiter(uint64_t& generation);
+
+	// Takes it back out of the slot, once it is out of m_state.
+	void remove_waiter(size_t slot, uint64_t generation) noexcept;
+
+	enum wakeup_kind {
+		wakeup_taken,     // ours, and taken
+		wakeup_not_ours,  // for a waiter from before us
+		wakeup_stale,     // for nobody, now that its waiter is written off
+	};
+
+	// What to make of a count we got from the semaphore.
+	wakeup_kind take_wakeup(uint64_t generation) noexcept;
+
+	// Stops counting the caller as a waiter after a timeout.  Returns true if
+	// it had been given a wakeup meanwhile, which it has now taken instead.
+	bool take_wakeup_or_leave(uint64_t generation) noexcept;
+
+	// Writes off the waiters of processes that have died.
+	void expire_dead_waiters() noexcept;
+
+private:
+	// Waiters, wakeups given out and not yet taken, and the generation, in
+	// one word so that a notify sees all of them at once.
+	std::atomic<uint64_t> m_state;
+
+	uint64_t m_id;
+
+	waiting_process m_processes[max_waiting_processes];
+};
+
+} // namespace iprog
+
+#endif//_IPROG_INTERPROCESS_CONDITION_VARIABLE_
\ No newline at end of file
@@ -0,0 +1,124 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_INTERPROCESS_MUTEX_
+#define _IPROG_INTERPROCESS_MUTEX_
+
+#include <atomic>
+#include <cstdint>
+#include <system_error>
+
+#include "override_terminate.hpp"
+
+// A mutex that can live in memory shared between processes, such as a file
+// mapping.  All of its state is inside the object and holds no pointers or
+// handles, so it works at whatever address each process maps it at.
+// Construct it in place once, in one process.  The others just use it.
+//
+// Locking and unlocking without contention are plain atomic operations.
+// Waiters sleep on a named semaphore, derived from an ID picked when the
+// mutex is constructed, which each process opens the first time it has to.
+//
+// If a process dies while holding the mutex, the next process to lock it
+// gets it as usual, but owner_died() then returns true, to say that whatever
+// it protects may be half updated, like EOWNERDEAD does for a robust pthread
+// mutex.  The new owner should repair the data and call consistent():
+//
+//     lock_guard<interprocess_mutex> lg(m);
+//     if (m.owner_died()) {
+//         repair();
+//         m.consistent();
+//     }
+//
+// If it unlocks without doing so, every lock() from then on throws
+// std::errc::state_not_recoverable.
+//
+// Death is noticed per process, by process ID.  Waiters check on the owner
+// every owner_check_interval_ms, since it can pass to another process while
+// they sleep, so there is no one process they could wait on instead.
+
+namespace iprog {
+
+namespace detail {
+
+// The semaphore named after `id`, opened once per process.
+void* interprocess_semaphore(uint64_t id);
+
+// Closes this process's handle to it, if it has one.
+void interprocess_forget(uint64_t id) noexcept;
+
+// An ID that no other live interprocess object has.
+uint64_t interprocess_make_id() noexcept;
+
+} // namespace detail
+
+class interprocess_mutex
+{
+public:
+	static_assert(ATOMIC_INT_LOCK_FREE == 2, "interprocess_mutex needs lock free atomics");
+
+	// How long a waiter sleeps between checks on whether the owner is alive.
+	static const uint32_t owner_check_interval_ms = 100;
+
+	interprocess_mutex() noexcept;
+
+	// Only closes this process's handle to the semaphore.
+	~interprocess_mutex() noexcept;
+
+	interprocess_mutex(const interprocess_mutex&) = delete;
+	interprocess_mutex& operator=(const interprocess_mutex&) = delete;
+
+	void lock();
+
+	bool try_lock();
+
+	void unlock();
+
+	// Check, while holding the mutex, whether it was taken over from a
+	// process that died holding it, and hasn't been made consistent since.
+	bool owner_died() const noexcept {
+		return (m_flags.load(std::memory_order_acquire) & inconsistent_bit) != 0;
+	}
+
+	// Marks the data as repaired after owner_died().
+	void consistent();
+
+private:
+	friend class interprocess_condition_variable;
+
+	static const uint32_t unlocked = 0;
+	static const uint32_t locked = 1;
+	static const uint32_t locked_contended = 2;
+
+	static const uint32_t inconsistent_bit = 1;
+	static const uint32_t not_recoverable_bit = 2;
+
+	void lock_slow();
+
+	void acquired() noexcept;
+
+	bool claim_if_owner_dead();
+
+	void check_recoverable();
+
+private:
+	std::atomic<uint32_t> m_state;
+
+	// Who holds it, so others can tell if it died.
+	std::atomic<uint32_t> m_owner_pid;
+	std::atomic<uint32_t> m_owner_tid;
+
+	std::atomic<uint32_t> m_flags;
+
+	// Threads in any process sleeping on the semaphore, or about to.
+	std::atomic<uint32_t> m_waiters;
+
+	uint64_t m_id;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_INTERPROCESS_MUTEX_
\ No newline at end of file
@@ -0,0 +1,261 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_IO_CONTEXT_
+#define _IPROG_IO_CONTEXT_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "override_terminate.hpp"
+#include "fair_mutex.hpp"
+#include "ticks.hpp"
+
+// A completion based event loop on top of an I/O completion port.  Handles
+// opened for overlapped I/O are registered with it, and every overlapped
+// operation started on them carries the handler to call when it completes.
+// Any number of threads may call run() on the same context, and handlers are
+// spread across them.
+//
+// Completion ports only exist on NT.  On 9x, the constructor throws.
+
+namespace iprog {
+
+class io_context;
+
+// An overlapped operation in flight.  Pass overlapped() as the OVERLAPPED*
+// of a ReadFile, WSARecv and so on, on a handle registered with the context
+// that made it.  Its handler runs once the operation completes, and then it
+// frees itself.
+class io_operation
+{
+public:
+	io_operation(const io_operation&) = delete;
+	io_operation& operator=(const io_operation&) = delete;
+
+	void* overlapped() noexcept {
+		return m_overlapped;
+	}
+
+protected:
+	// Called with `ec` null to free the operation without running it.
+	typedef void (*complete_function)(io_operation* op, const std::error_code* ec, size_t bytes);
+
+	explicit io_operation(complete_function complete) noexcept : m_complete(complete) {
+		memset(m_overlapped, 0, sizeof m_overlapped);
+	}
+
+	~io_operation() {}
+
+private:
+	friend class io_context;
+
+	// Storage for the OVERLAPPED.  Must come first, since a completion only
+	// gives us its address back.
+	uintptr_t m_overlapped[5];
+
+	complete_function m_complete;
+};
+
+namespace detail {
+
+template<class F>
+class io_handler_operation : public io_operation
+{
+public:
+	explicit io_handler_operation(F&& handler) : io_operation(&complete), m_handler(std::move(handler)) {}
+
+private:
+	// Frees the operation before calling the handler, so the handler can
+	// start the next operation right away.
+	static void complete(io_operation* base, const std::error_code* ec, size_t bytes) {
+		io_handler_operation* self = static_cast<io_handler_operation*>(base);
+		F handler(std::move(self->m_handler));
+		delete self;
+
+		if (ec)
+			handler(*ec, bytes);
+	}
+
+	F m_handler;
+};
+
+// Adapts a handler taking no arguments.
+template<class F>
+struct io_nullary_handler
+{
+	explicit io_nullary_handler(F&& f) : m_f(std::move(f)) {}
+
+	void operator()(const std::error_code&, size_t) {
+		m_f();
+	}
+
+	F m_f;
+};
+
+} // namespace detail
+
+class io_context
+{
+public:
+	typedef uint64_t timer_id;
+
+	// Keeps run() from returning for lack of work while it exists.
+	class work
+	{
+	public:
+		explicit work(io_context& ctx) noexcept : m_ctx(&ctx) {
+			m_ctx->work_started();
+		}
+
+		~work() noexcept {
+			if (m_ctx)
+				m_ctx->work_finished();
+		}
+
+		work(const work&) = delete;
+		work& operator=(const work&) = delete;
+
+		// Gives up the work early.
+		void reset() noexcept {
+			if (m_ctx)
+				m_ctx->work_finished();
+			m_ctx = nullptr;
+		}
+
+	private:
+		io_context* m_ctx;
+	};
+
+	// At most `concurrency_hint` threads run handlers at the same time, while
+	// none of them block.  Zero means one per processor.
+	explicit io_context(unsigned concurrency_hint = 0);
+
+	// Pending handlers and timers are freed without being run.  Operations
+	// still in flight must have been cancelled and completed by now, since
+	// the system owns their OVERLAPPED until then.
+	~io_context() noexcept;
+
+	io_context(const io_context&) = delete;
+	io_context& operator=(const io_context&) = delete;
+
+	// Routes the completions of `handle`, which must have been opened for
+	// overlapped I/O, to this context.  A handle can only ever belong to one.
+	void register_handle(void* handle);
+
+	// Makes an operation whose completion calls handler(error_code, bytes).
+	// It counts as work until it completes.
+	template<class F>
+	io_operation* make_operation(F handler) {
+		io_operation* op = new detail::io_handler_operation<F>(std::move(handler));
+		work_started();
+		return op;
+	}
+
+	// For an operation that failed to start.  Its handler is called with `ec`
+	// from run(), like any other completion.
+	void fail(io_operation* op, const std::error_code& ec);
+
+	// Calls f() from run(), on whichever thread gets to it first.
+	template<class F>
+	void post(F f) {
+		enqueue(make_operation(detail::io_nullary_handler<F>(std::move(f))));
+	}
+
+	// Calls f() from run() once `rel_time` has passed.  The returned id can be
+	// used to cancel it until then.
+	template<class F, class Rep, class Per>
+	timer_id post_after(const std::chrono::duration<Rep, Per>& rel_time, F f) {
+		return schedule(detail::to_nanoseconds(rel_time), make_operation(detail::io_nullary_handler<F>(std::move(f))));
+	}
+
+	template<class F, class Clock, class Duration>
+	timer_id post_at(const std::chrono::time_point<Clock, Duration>& abs_time, F f) {
+		return post_after(abs_time - Clock::now(), std::move(f));
+	}
+
+	// Drops a timer that hasn't fired yet, without calling it.  Returns false
+	// if it already fired or was cancelled.
+	bool cancel(timer_id id) noexcept;
+
+	// Runs handlers until stopped or out of work.  Returns how many ran.
+	size_t run();
+
+	// Runs at most one handler, waiting for one if needed.
+	size_t run_one();
+
+	// Runs every handler that is ready, without waiting.
+	size_t poll();
+
+	// Runs at most one handler that is ready, without waiting.
+	size_t poll_one();
+
+	// Makes every run() return as soon as it can.  Handlers that haven't run
+	// stay queued until the next run(), after a restart().
+	void stop() noexcept;
+
+	bool stopped() const noexcept {
+		return m_stopped.load(std::memory_order_acquire);
+	}
+
+	// Must be called before running again after a stop, or after running out
+	// of work.
+	void restart() noexcept {
+		m_stopped.store(false, std::memory_order_release);
+	}
+
+private:
+	struct timer_entry
+	{
+		int64_t m_deadline; // performance counter ticks
+		timer_id m_id;
+		io_operation* m_op;
+	};
+
+	void work_started() noexcept {
+		m_outstanding.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void work_finished() noexcept {
+		if (m_outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			stop();
+	}
+
+	void enqueue(io_operation* op);
+
+	timer_id schedule(int64_t ns, io_operation* op);
+
+	static bool later_deadline(const timer_entry& a, const timer_entry& b) noexcept;
+
+	size_t do_run_one(uint32_t timeout);
+
+	bool run_due_timer();
+
+	int64_t next_deadline() noexcept;
+
+	void wake_one() noexcept;
+
+private:
+	void* m_port;
+
+	std::atomic<long> m_outstanding{ 0 };
+
+	std::atomic<bool> m_stopped{ false };
+
+	// A binary min-heap on the deadline.
+	fair_mutex m_timer_mutex;
+	std::vector<timer_entry> m_timers;
+	timer_id m_next_timer_id = 1;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_IO_CONTEXT_
\ No newline at end of file
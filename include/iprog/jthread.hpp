@@ -0,0 +1,147 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_JTHREAD_
+#define _IPROG_JTHREAD_
+
+#include <type_traits>
+#include <utility>
+
+#include "override_terminate.hpp"
+#include "thread.hpp"
+#include "stop_token.hpp"
+
+namespace iprog {
+
+// A thread which requests a stop and joins on destruction.  If the thread
+// function accepts a stop_token as its first argument, it is passed one that
+// is tied to this jthread's stop_source.
+class jthread
+{
+private:
+	typedef void* native_handle_type;
+
+	template<class T>
+	using decay_type = typename std::decay<T>::type;
+
+	// Whether F can be called as f(stop_token, args...).
+	template<class F, class... Args>
+	struct takes_stop_token
+	{
+		template<class G>
+		static auto test(int) -> decltype(std::declval<G&>()(std::declval<stop_token&>(), std::declval<decay_type<Args>&>()...), std::true_type());
+
+		template<class G>
+		static std::false_type test(...);
+
+		static constexpr bool value = decltype(test<decay_type<F>>(0))::value;
+	};
+
+public:
+	typedef thread::id id;
+
+	// Creates a new jthread object which does not represent a thread.
+	jthread() noexcept : m_source(nostopstate) {}
+
+	// Creates a new jthread object and associates it with a thread of execution.
+	template<class F, class... Args,
+		class = typename std::enable_if<!std::is_same<decay_type<F>, jthread>::value>::type>
+	explicit jthread(F&& f, Args&&... args) {
+		start(std::integral_constant<bool, takes_stop_token<F, Args...>::value>(),
+			std::forward<F>(f), std::forward<Args>(args)...);
+	}
+
+	// Requests a stop and joins the thread, if it is joinable.
+	~jthread() noexcept {
+		stop_and_join();
+	}
+
+	jthread(const jthread&) = delete;
+	jthread& operator=(const jthread&) = delete;
+
+	jthread(jthread&& other) noexcept :
+		m_source(std::move(other.m_source)),
+		m_thread(std::move(other.m_thread)) {}
+
+	jthread& operator=(jthread&& other) noexcept {
+		stop_and_join();
+		m_source = std::move(other.m_source);
+		m_thread = std::move(other.m_thread);
+		return (*this);
+	}
+
+	bool joinable() const noexcept {
+		return m_thread.joinable();
+	}
+
+	void join() {
+		m_thread.join();
+	}
+
+	void detach() {
+		m_thread.detach();
+	}
+
+	id get_id() const noexcept {
+		return m_thread.get_id();
+	}
+
+	native_handle_type native_handle() const noexcept {
+		return m_thread.native_handle();
+	}
+
+	stop_source get_stop_source() noexcept {
+		return m_source;
+	}
+
+	stop_token get_stop_token() const noexcept {
+		return m_source.get_token();
+	}
+
+	bool request_stop() {
+		return m_source.request_stop();
+	}
+
+	void swap(jthread& other) noexcept {
+		m_source.swap(other.m_source);
+		m_thread.swap(other.m_thread);
+	}
+
+	static unsigned int hardware_concurrency() noexcept {
+		return thread::hardware_concurrency();
+	}
+
+private:
+	template<class F, class... Args>
+	void start(std::true_type, F&& f, Args&&... args) {
+		m_thread = thread(std::forward<F>(f), m_source.get_token(), std::forward<Args>(args)...);
+	}
+
+	template<class F, class... Args>
+	void start(std::false_type, F&& f, Args&&... args) {
+		m_thread = thread(std::forward<F>(f), std::forward<Args>(args)...);
+	}
+
+	void stop_and_join() noexcept {
+		if (!joinable())
+			return;
+
+		m_source.request_stop();
+		m_thread.join();
+	}
+
+private:
+	stop_source m_source;
+	thread m_thread;
+};
+
+inline void swap(jthread& a, jthread& b) noexcept {
+	a.swap(b);
+}
+
+} // namespace iprog
+
+#endif//_IPROG_JTHREAD_
\ No newline at end of file
@@ -0,0 +1,90 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_LOCK_
+#define _IPROG_LOCK_
+
+#include <cstddef>
+
+#include "override_terminate.hpp"
+
+// Deadlock-free locking of several lockables at once, in the style of
+// std::lock and std::try_lock.
+
+namespace iprog {
+
+namespace detail {
+
+// A type-erased reference to anything with lock(), try_lock() and unlock().
+struct lockable_ref
+{
+	void* m_object;
+	void (*m_lock)(void*);
+	bool (*m_try_lock)(void*);
+	void (*m_unlock)(void*);
+};
+
+template<class L>
+struct lockable_ops
+{
+	static void lock(void* p) {
+		static_cast<L*>(p)->lock();
+	}
+	static bool try_lock(void* p) {
+		return static_cast<L*>(p)->try_lock();
+	}
+	static void unlock(void* p) {
+		static_cast<L*>(p)->unlock();
+	}
+};
+
+template<class L>
+lockable_ref make_lockable_ref(L& l) noexcept {
+	lockable_ref ref = { &l, &lockable_ops<L>::lock, &lockable_ops<L>::try_lock, &lockable_ops<L>::unlock };
+	return ref;
+}
+
+// Locks all `count` lockables without deadlocking.  Blocks on one of them,
+// tries the rest, and if any of them fails, backs off and blocks on the one
+// that failed next time around.
+void lock_all(lockable_ref* locks, size_t count);
+
+// Tries to lock all `count` lockables in order.  Returns -1 if all of them
+// were locked, otherwise the index of the first one that couldn't be locked.
+int try_lock_all(lockable_ref* locks, size_t count);
+
+// Unlocks all `count` lockables.
+void unlock_all(lockable_ref* locks, size_t count) noexcept;
+
+} // namespace detail
+
+// Locks all of the given lockables, without deadlocking against another
+// thread locking an overlapping set in a different order.
+template<class L1, class L2, class... Ln>
+void lock(L1& l1, L2& l2, Ln&... ln) {
+	detail::lockable_ref refs[] = {
+		detail::make_lockable_ref(l1),
+		detail::make_lockable_ref(l2),
+		detail::make_lockable_ref(ln)...
+	};
+	detail::lock_all(refs, 2 + sizeof...(Ln));
+}
+
+// Tries to lock all of the given lockables in order.  Returns -1 on success,
+// or the 0-based index of the lockable that failed, with none of them held.
+template<class L1, class L2, class... Ln>
+int try_lock(L1& l1, L2& l2, Ln&... ln) {
+	detail::lockable_ref refs[] = {
+		detail::make_lockable_ref(l1),
+		detail::make_lockable_ref(l2),
+		detail::make_lockable_ref(ln)...
+	};
+	return detail::try_lock_all(refs, 2 + sizeof...(Ln));
+}
+
+} // namespace iprog
+
+#endif//_IPROG_LOCK_
\ No newline at end of file
@@ -0,0 +1,227 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_PARALLEL_
+#define _IPROG_PARALLEL_
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "override_terminate.hpp"
+
+// Data parallel loops over a shared set of worker threads, one per processor
+// besides the calling thread.  A range is split in halves, down to the grain
+// size, as it is being run.  The halves that aren't being worked on yet can
+// be stolen by idle workers, so uneven work still balances out.
+//
+// The calling thread helps until the whole range is done, and so do workers
+// that call these from inside a loop body, so nesting them is fine.  If a
+// body throws, the rest of the range is skipped where possible, and the first
+// exception is rethrown to the caller.
+
+namespace iprog {
+
+namespace detail {
+
+typedef void (*parallel_body)(void* context, size_t lo, size_t hi);
+
+// Runs body(context, lo, hi) over subranges that together cover
+// [first, last), none longer than `grain`.
+void parallel_run(parallel_body body, void* context, size_t first, size_t last, size_t grain);
+
+// A grain that gives each participating thread several pieces of `count`.
+size_t parallel_default_grain(size_t count) noexcept;
+
+template<class F>
+void parallel_call_body(void* context, size_t lo, size_t hi) {
+	(*static_cast<F*>(context))(lo, hi);
+}
+
+} // namespace detail
+
+// Sets how many threads, the calling one included, the algorithms below run
+// on, instead of one per processor.  This has to be done before the first of
+// them runs, which starts the workers; after that it throws
+// operation_not_permitted.
+void set_parallel_concurrency(unsigned threads);
+
+// Calls f(lo, hi) for subranges of [first, last), with up to `grain` indices
+// each, in parallel.
+template<class F>
+void parallel_for(size_t first, size_t last, size_t grain, F f) {
+	if (first >= last)
+		return;
+
+	detail::parallel_run(&detail::parallel_call_body<F>, &f, first, last, grain ? grain : 1);
+}
+
+template<class F>
+void parallel_for(size_t first, size_t last, F f) {
+	if (first >= last)
+		return;
+
+	parallel_for(first, last, detail::parallel_default_grain(last - first), std::move(f));
+}
+
+// Runs f1 and f2, possibly in parallel, and returns when both are done.
+template<class F1, class F2>
+void parallel_invoke(F1 f1, F2 f2) {
+	parallel_for(0, 2, 1, [&](size_t lo, size_t hi) {
+		for (size_t i = lo; i < hi; i++) {
+			if (i == 0)
+				f1();
+			else
+				f2();
+		}
+	});
+}
+
+namespace detail {
+
+// Splits the same way parallel_run does, and combines the two halves' results
+// as they come back, so no list of results is collected anywhere.
+template<class T, class Map, class Reduce>
+T parallel_reduce_impl(size_t lo, size_t hi, size_t grain, const T& identity, Map& map, Reduce& reduce) {
+	if (hi - lo <= grain)
+		return map(lo, hi);
+
+	size_t mid = lo + (hi - lo) / 2;
+	T lower(identity), upper(identity);
+	parallel_invoke(
+		[&]() { lower = parallel_reduce_impl(lo, mid, grain, identity, map, reduce); },
+		[&]() { upper = parallel_reduce_impl(mid, hi, grain, identity, map, reduce); }
+	);
+	return reduce(std::move(lower), std::move(upper));
+}
+
+} // namespace detail
+
+// Computes map(lo, hi) for subranges of [first, last) in parallel, combines
+// neighbouring results with reduce(lower, upper), and folds the total into
+// `identity`.  So `reduce` needs to be associative, but not commutative.
+template<class T, class Map, class Reduce>
+T parallel_reduce(size_t first, size_t last, size_t grain, T identity, Map map, Reduce reduce) {
+	if (first >= last)
+		return identity;
+
+	T result = detail::parallel_reduce_impl(first, last, grain ? grain : 1, identity, map, reduce);
+	return reduce(std::move(identity), std::move(result));
+}
+
+template<class T, class Map, class Reduce>
+T parallel_reduce(size_t first, size_t last, T identity, Map map, Reduce reduce) {
+	if (first >= last)
+		return identity;
+
+	return parallel_reduce(first, last, detail::parallel_default_grain(last - first), std::move(identity), std::move(map), std::move(reduce));
+}
+
+// Stores f(*it) for every `it` in [first, last) to the matching position
+// starting at `out`.  Both need to be random access iterators.
+template<class InIt, class OutIt, class F>
+OutIt parallel_transform(InIt first, InIt last, OutIt out, F f) {
+	size_t count = size_t(std::distance(first, last));
+	parallel_for(0, count, [&](size_t lo, size_t hi) {
+		InIt in = first + lo;
+		OutIt to = out + lo;
+		for (size_t i = lo; i < hi; i++, ++in, ++to)
+			*to = f(*in);
+	});
+	return out + count;
+}
+
+namespace detail {
+
+// Below this many elements, sorting or merging isn't worth handing out.
+static const size_t parallel_sort_cutoff = 2048;
+
+// Moves the sorted runs [a, a_end) and [b, b_end) into `out`, merged.  The
+// bigger run is cut in half, and the other one where its middle element would
+// go, so both halves of the output can be filled in parallel.
+template<class It, class Out, class Compare>
+void parallel_merge(It a, It a_end, It b, It b_end, Out out, Compare& comp) {
+	size_t count_a = size_t(a_end - a);
+	size_t count_b = size_t(b_end - b);
+	if (count_a + count_b <= parallel_sort_cutoff) {
+		std::merge(std::make_move_iterator(a), std::make_move_iterator(a_end),
+			std::make_move_iterator(b), std::make_move_iterator(b_end), out, comp);
+		return;
+	}
+
+	if (count_a < count_b) {
+		std::swap(a, b);
+		std::swap(a_end, b_end);
+		std::swap(count_a, count_b);
+	}
+
+	It a_mid = a + count_a / 2;
+	It b_mid = std::lower_bound(b, b_end, *a_mid, comp);
+	Out out_mid = out + (a_mid - a) + (b_mid - b);
+
+	parallel_invoke(
+		[&]() { parallel_merge(a, a_mid, b, b_mid, out, comp); },
+		[&]() { parallel_merge(a_mid, a_end, b_mid, b_end, out_mid, comp); }
+	);
+}
+
+// Sorts [first, last), using `other`, which is as long, as the buffer.  The
+// result ends up in `other` if `into_other` is set.  Every level moves the
+// elements across once, merging the halves that the level below left on the
+// other side.
+template<class It, class Other, class Compare>
+void parallel_sort_impl(It first, It last, Other other, Compare& comp, bool into_other) {
+	size_t count = size_t(last - first);
+	if (count <= parallel_sort_cutoff) {
+		std::sort(first, last, comp);
+		if (into_other)
+			std::move(first, last, other);
+		return;
+	}
+
+	size_t half = count / 2;
+	parallel_invoke(
+		[&]() { parallel_sort_impl(first, first + half, other, comp, !into_other); },
+		[&]() { parallel_sort_impl(first + half, last, other + half, comp, !into_other); }
+	);
+
+	if (into_other)
+		parallel_merge(first, first + half, first + half, last, other, comp);
+	else
+		parallel_merge(other, other + half, other + half, other + count, first, comp);
+}
+
+} // namespace detail
+
+// Sorts [first, last), a random access range, with a parallel merge sort.
+// Every level, including the merges at the top, is split between threads,
+// at the cost of a buffer as big as the range.  Like std::sort, it isn't
+// stable.
+template<class It, class Compare>
+void parallel_sort(It first, It last, Compare comp) {
+	typedef typename std::iterator_traits<It>::value_type value_type;
+
+	size_t count = size_t(last - first);
+	if (count <= detail::parallel_sort_cutoff) {
+		std::sort(first, last, comp);
+		return;
+	}
+
+	std::vector<value_type> buffer(std::make_move_iterator(first), std::make_move_iterator(last));
+	detail::parallel_sort_impl(buffer.begin(), buffer.end(), first, comp, true);
+}
+
+template<class It>
+void parallel_sort(It first, It last) {
+	parallel_sort(first, last, std::less<typename std::iterator_traits<It>::value_type>());
+}
+
+} // namespace iprog
+
+#endif//_IPROG_PARALLEL_
\ No newline at end of file
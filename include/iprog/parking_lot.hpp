@@ -0,0 +1,111 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_PARKING_LOT_
+#define _IPROG_PARKING_LOT_
+
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+
+#include "override_terminate.hpp"
+#include "w32constants.hpp"
+
+// A global table of address-keyed wait queues, in the style of WebKit's
+// ParkingLot.  Any word in memory can be waited on without owning a kernel
+// object; only threads that are actually asleep cost anything, and the only
+// kernel object involved is one event per thread that has ever parked.
+
+namespace iprog {
+
+enum class park_status {
+	unparked,  // woken by unpark_one or unpark_all
+	invalid,   // the validation callback returned false
+	timed_out, // the timeout elapsed first
+};
+
+struct park_result
+{
+	park_status status;
+
+	// The token handed over by the thread that unparked us.
+	intptr_t token;
+};
+
+struct unpark_result
+{
+	// Whether a thread was taken off the queue.
+	bool unparked_thread;
+
+	// Whether more threads are still parked on the same address.
+	bool have_more_threads;
+};
+
+class parking_lot
+{
+public:
+	// Parks the calling thread on `address`.  `validate` runs with the queue
+	// for `address` locked; if it returns false, the thread does not park.
+	// `before_sleep` runs after the queue is unlocked, just before sleeping.
+	// Neither callback may use the parking lot itself.
+	template<class Validate, class BeforeSleep>
+	static park_result park(const void* address, Validate validate, BeforeSleep before_sleep, uint32_t timeout_ms = __infinite) {
+		return park_impl(address, &call_validate<Validate>, &validate, &call_before_sleep<BeforeSleep>, &before_sleep, timeout_ms);
+	}
+
+	template<class Validate>
+	static park_result park(const void* address, Validate validate) {
+		return park_impl(address, &call_validate<Validate>, &validate, nullptr, nullptr, __infinite);
+	}
+
+	// Like park(), but gives up after `timeout_ms`.  It has a name of its own
+	// so that a timeout can't be taken for a `before_sleep` callback.
+	template<class Validate>
+	static park_result park_for(const void* address, Validate validate, uint32_t timeout_ms) {
+		return park_impl(address, &call_validate<Validate>, &validate, nullptr, nullptr, timeout_ms);
+	}
+
+	// Unparks the longest waiting thread parked on `address`.  `callback`
+	// runs with the queue locked, whether or not a thread was found, and
+	// returns the token that the woken thread will receive.
+	template<class Callback>
+	static unpark_result unpark_one(const void* address, Callback callback) {
+		return unpark_one_impl(address, &call_callback<Callback>, &callback);
+	}
+
+	static unpark_result unpark_one(const void* address) {
+		return unpark_one_impl(address, nullptr, nullptr);
+	}
+
+	// Unparks every thread parked on `address`, passing them all `token`.
+	// Returns how many threads were woken.
+	static size_t unpark_all(const void* address, intptr_t token = 0);
+
+private:
+	template<class Validate>
+	static bool call_validate(void* context) {
+		return (*static_cast<Validate*>(context))();
+	}
+
+	template<class BeforeSleep>
+	static void call_before_sleep(void* context) {
+		(*static_cast<BeforeSleep*>(context))();
+	}
+
+	template<class Callback>
+	static intptr_t call_callback(void* context, unpark_result result) {
+		return (*static_cast<Callback*>(context))(result);
+	}
+
+	static park_result park_impl(const void* address, bool (*validate)(void*), void* validate_context,
+		void (*before_sleep)(void*), void* before_sleep_context, uint32_t timeout_ms);
+
+	static unpark_result unpark_one_impl(const void* address, intptr_t (*callback)(void*, unpark_result), void* context);
+};
+
+} // namespace iprog
+
+#endif//_IPROG_PARKING_LOT_
\ No newline at end of file
@@ -0,0 +1,232 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_PER_THREAD_
+#define _IPROG_PER_THREAD_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "override_terminate.hpp"
+
+namespace iprog {
+
+namespace detail {
+
+// A small number which is unique among the live threads that have asked for
+// one.  It is handed out on first use, and reused by another thread after the
+// iprog::thread that held it exits.
+size_t this_thread_slot();
+
+} // namespace detail
+
+// One cache-line padded T per thread.  Each thread only ever writes its own
+// slot, so nothing is shared until somebody reads all of them.
+//
+// When a thread exits, its slot is handed to the next thread that needs one,
+// value and all.  So anything accumulated by a thread that has gone away is
+// still included by for_each and combine.
+template<class T>
+class per_thread
+{
+private:
+	static const size_t cache_line = 64;
+	static const size_t first_bucket_size = 8;
+	static const size_t bucket_count = 32;
+
+	struct alignas(cache_line) slot
+	{
+		T m_value;
+
+		template<class... Args>
+		explicit slot(Args&&... args) : m_value(std::forward<Args>(args)...) {}
+	};
+
+public:
+	// Slots start out value-initialized.
+	per_thread() : m_prototype(nullptr), m_construct(&construct_default) {
+		init_buckets();
+	}
+
+	// Slots start out as copies of `init`.
+	explicit per_thread(const T& init) : m_prototype(new T(init)), m_construct(&construct_copy) {
+		init_buckets();
+	}
+
+	~per_thread() noexcept {
+		for (size_t b = 0; b < bucket_count; b++) {
+			slot* slots = m_buckets[b].load(std::memory_order_relaxed);
+			if (!slots)
+				continue;
+
+			for (size_t i = 0; i < bucket_size(b); i++)
+				slots[i].~slot();
+			delete[] m_raw[b];
+		}
+		delete m_prototype;
+	}
+
+	per_thread(const per_thread&) = delete;
+	per_thread& operator=(const per_thread&) = delete;
+
+	// The calling thread's slot.
+	T& local() {
+		size_t index = detail::this_thread_slot();
+		size_t b = 0;
+		while (index >= bucket_size(b)) {
+			index -= bucket_size(b);
+			b++;
+		}
+
+		slot* slots = m_buckets[b].load(std::memory_order_acquire);
+		if (!slots)
+			slots = allocate_bucket(b);
+		return slots[index].m_value;
+	}
+
+	// Calls f(const T&) for every slot that exists, whether or not a thread
+	// is using it right now.  The owning threads may be writing concurrently,
+	// so T should be something that can be read while that happens.
+	template<class F>
+	void for_each(F f) const {
+		for (size_t b = 0; b < bucket_count; b++) {
+			const slot* slots = m_buckets[b].load(std::memory_order_acquire);
+			if (!slots)
+				continue;
+
+			for (size_t i = 0; i < bucket_size(b); i++)
+				f(slots[i].m_value);
+		}
+	}
+
+	// Folds every slot into `init` with op(accumulated, slot).
+	template<class R, class Op>
+	R combine(R init, Op op) const {
+		for_each([&](const T& value) {
+			init = op(init, value);
+		});
+		return init;
+	}
+
+private:
+	static size_t bucket_size(size_t b) noexcept {
+		return first_bucket_size << b;
+	}
+
+	// Picked by the constructor, so that T only has to be copyable when an
+	// initial value is given.
+	static void construct_default(slot* where, const T*) {
+		new (where) slot();
+	}
+
+	static void construct_copy(slot* where, const T* prototype) {
+		new (where) slot(*prototype);
+	}
+
+	void init_buckets() noexcept {
+		for (size_t b = 0; b < bucket_count; b++) {
+			m_buckets[b].store(nullptr, std::memory_order_relaxed);
+			m_raw[b] = nullptr;
+		}
+	}
+
+	slot* allocate_bucket(size_t b) {
+		size_t count = bucket_size(b);
+
+		// new[] doesn't promise more than the default alignment before C++17,
+		// so line the slots up by hand.
+		char* raw = new char[count * sizeof(slot) + cache_line];
+		uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + cache_line - 1) & ~uintptr_t(cache_line - 1);
+		slot* slots = reinterpret_cast<slot*>(aligned);
+
+		size_t built = 0;
+		try
+		{
+			for (; built < count; built++) {
+				m_construct(&slots[built], m_prototype);
+			}
+		}
+		catch (...)
+		{
+			while (built--)
+				slots[built].~slot();
+			delete[] raw;
+			throw;
+		}
+
+		// Somebody else may have got there first.
+		slot* expected = nullptr;
+		if (m_buckets[b].compare_exchange_strong(expected, slots, std::memory_order_acq_rel, std::memory_order_acquire)) {
+			m_raw[b] = raw;
+			return slots;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			slots[i].~slot();
+		delete[] raw;
+		return expected;
+	}
+
+private:
+	std::atomic<slot*> m_buckets[bucket_count];
+
+	// What new[] returned for each bucket.  Only written by the thread that
+	// won the race to install the bucket, and only read by the destructor.
+	char* m_raw[bucket_count];
+
+	const T* m_prototype;
+
+	void (*m_construct)(slot*, const T*);
+};
+
+// A counter which any number of threads can bump without fighting over a
+// cache line.  Each increment is a plain load and store on the calling
+// thread's own slot; value() adds all of the slots up.
+class sharded_counter
+{
+public:
+	sharded_counter() {}
+
+	sharded_counter(const sharded_counter&) = delete;
+	sharded_counter& operator=(const sharded_counter&) = delete;
+
+	void add(int64_t n) {
+		std::atomic<int64_t>& mine = m_slots.local();
+		mine.store(mine.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	void increment() {
+		add(1);
+	}
+
+	sharded_counter& operator+=(int64_t n) {
+		add(n);
+		return (*this);
+	}
+
+	sharded_counter& operator++() {
+		add(1);
+		return (*this);
+	}
+
+	// The sum of every thread's slot.  Increments that happen while this runs
+	// may or may not be counted.
+	int64_t value() const {
+		return m_slots.combine(int64_t(0), [](int64_t sum, const std::atomic<int64_t>& v) {
+			return sum + v.load(std::memory_order_relaxed);
+		});
+	}
+
+private:
+	per_thread<std::atomic<int64_t>> m_slots;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_PER_THREAD_
\ No newline at end of file
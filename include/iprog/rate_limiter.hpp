@@ -0,0 +1,152 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_RATE_LIMITER_
+#define _IPROG_RATE_LIMITER_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "override_terminate.hpp"
+#include "concurrent_hash_map.hpp"
+#include "ticks.hpp"
+
+// Token bucket rate limiting, done as the generic cell rate algorithm: the
+// whole bucket is one atomic timestamp, the time at which it would be full
+// again.  Taking tokens pushes it forward, and is allowed as long as that
+// doesn't put it more than a burst's worth of time ahead of now.  So
+// try_acquire() is a compare and swap, with no lock.
+//
+// acquire() pushes the timestamp forward right away, whether or not there
+// are enough tokens yet, which reserves the caller a slot.  Then it sleeps
+// until that slot comes, once, without polling.  Since slots are handed out
+// in the order callers reserve them, blocked callers are let through in the
+// order they arrived.
+
+namespace iprog {
+
+template<class Key, class Hash>
+class keyed_rate_limiter;
+
+class rate_limiter
+{
+public:
+	// Refills `rate` tokens per second, and holds up to `burst`.
+	rate_limiter(double rate, double burst);
+
+	rate_limiter(const rate_limiter&) = delete;
+	rate_limiter& operator=(const rate_limiter&) = delete;
+
+	// Takes `n` tokens if there are that many.  More than `burst` can only
+	// ever be had by waiting.
+	bool try_acquire(int64_t n = 1) {
+		return reserve(this, nullptr, n, 0, false);
+	}
+
+	// Waits until `n` tokens are ours.
+	void acquire(int64_t n = 1) {
+		reserve(this, nullptr, n, -1, true);
+	}
+
+	// Waits for `n` tokens, unless that would take longer than `rel_time`,
+	// in which case it returns false right away.
+	template<class Rep, class Per>
+	bool try_acquire_for(int64_t n, const std::chrono::duration<Rep, Per>& rel_time) {
+		return reserve(this, nullptr, n, detail::to_nanoseconds(rel_time), true);
+	}
+
+	// Gives back tokens taken for something that didn't happen after all.
+	void refund(int64_t n = 1) noexcept;
+
+private:
+	template<class Key, class Hash>
+	friend class keyed_rate_limiter;
+
+	// Takes `n` tokens from `a`, and from `also` if it isn't null, at the
+	// same moment.  Fails if that moment is more than `max_wait_ns` away,
+	// which is negative for no limit.  If `wait` is true, sleeps until then.
+	static bool reserve(rate_limiter* a, rate_limiter* also, int64_t n, int64_t max_wait_ns, bool wait);
+
+	// In performance counter ticks.
+	int64_t m_interval;
+	int64_t m_tolerance;
+
+	// When the bucket would be full again.
+	std::atomic<int64_t> m_full_at{ 0 };
+};
+
+// Buckets by key, such as one per API route, which are made the first time a
+// key is used.  If it's given a global limiter, every acquire takes from it
+// too, and only succeeds if both have the tokens.  The same global limiter
+// can be shared by several keyed limiters.
+template<class Key, class Hash = std::hash<Key> >
+class keyed_rate_limiter
+{
+public:
+	// Keys without a limit of their own get `rate` and `burst`.
+	keyed_rate_limiter(double rate, double burst, rate_limiter* global = nullptr) :
+		m_rate(rate), m_burst(burst), m_global(global) {}
+
+	keyed_rate_limiter(const keyed_rate_limiter&) = delete;
+	keyed_rate_limiter& operator=(const keyed_rate_limiter&) = delete;
+
+	// Gives `key` a limit of its own, starting with a full bucket.
+	void set_limit(const Key& key, double rate, double burst) {
+		m_buckets.insert_or_assign(key, std::make_shared<rate_limiter>(rate, burst));
+	}
+
+	bool try_acquire(const Key& key, int64_t n = 1) {
+		bool acquired = false;
+		while (!m_buckets.visit(key, [&](const std::shared_ptr<rate_limiter>& bucket) {
+			acquired = rate_limiter::reserve(bucket.get(), m_global, n, 0, false);
+		}))
+			add_bucket(key);
+
+		return acquired;
+	}
+
+	void acquire(const Key& key, int64_t n = 1) {
+		// Holds on to the bucket, since it might be replaced while we sleep.
+		std::shared_ptr<rate_limiter> bucket = get_bucket(key);
+		rate_limiter::reserve(bucket.get(), m_global, n, -1, true);
+	}
+
+	template<class Rep, class Per>
+	bool try_acquire_for(const Key& key, int64_t n, const std::chrono::duration<Rep, Per>& rel_time) {
+		std::shared_ptr<rate_limiter> bucket = get_bucket(key);
+		return rate_limiter::reserve(bucket.get(), m_global, n, detail::to_nanoseconds(rel_time), true);
+	}
+
+	// Forgets a key's bucket, and any limit of its own.
+	void erase(const Key& key) {
+		m_buckets.erase(key);
+	}
+
+private:
+	void add_bucket(const Key& key) {
+		m_buckets.insert(key, std::make_shared<rate_limiter>(m_rate, m_burst));
+	}
+
+	std::shared_ptr<rate_limiter> get_bucket(const Key& key) {
+		std::shared_ptr<rate_limiter> bucket;
+		while (!m_buckets.find(key, bucket))
+			add_bucket(key);
+		return bucket;
+	}
+
+	double m_rate;
+	double m_burst;
+	rate_limiter* m_global;
+
+	concurrent_hash_map<Key, std::shared_ptr<rate_limiter>, Hash> m_buckets;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_RATE_LIMITER_
\ No newline at end of file
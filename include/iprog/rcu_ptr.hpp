@@ -0,0 +1,128 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_RCU_PTR_
+#define _IPROG_RCU_PTR_
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include "override_terminate.hpp"
+#include "epoch.hpp"
+#include "fair_mutex.hpp"
+#include "lock_guard.hpp"
+
+namespace iprog {
+
+// A pointer to read-mostly shared state.  Readers take a snapshot, which pins
+// the epoch and loads the pointer, without locking anything.  Writers publish
+// a whole new version, and the old one is freed once no snapshot can still be
+// looking at it.
+template<class T>
+class rcu_ptr
+{
+public:
+	// A pinned view of the version that was current when it was taken.  Don't
+	// keep it for long: while it is alive, nothing retired can be freed.
+	class snapshot
+	{
+	public:
+		snapshot(snapshot&& other) noexcept : m_ptr(other.m_ptr), m_pinned(other.m_pinned) {
+			other.m_ptr = nullptr;
+			other.m_pinned = false;
+		}
+
+		~snapshot() noexcept {
+			if (m_pinned)
+				epoch::leave();
+		}
+
+		snapshot(const snapshot&) = delete;
+		snapshot& operator=(const snapshot&) = delete;
+		snapshot& operator=(snapshot&&) = delete;
+
+		const T* get() const noexcept {
+			return m_ptr;
+		}
+
+		const T* operator->() const noexcept {
+			return m_ptr;
+		}
+
+		const T& operator*() const noexcept {
+			return *m_ptr;
+		}
+
+		explicit operator bool() const noexcept {
+			return m_ptr != nullptr;
+		}
+
+	private:
+		friend class rcu_ptr;
+
+		explicit snapshot(const std::atomic<T*>& ptr) : m_ptr(nullptr), m_pinned(false) {
+			epoch::enter();
+			m_pinned = true;
+			m_ptr = ptr.load(std::memory_order_acquire);
+		}
+
+		const T* m_ptr;
+		bool m_pinned;
+	};
+
+	rcu_ptr() noexcept : m_ptr(nullptr) {}
+
+	explicit rcu_ptr(std::unique_ptr<T> value) noexcept : m_ptr(value.release()) {}
+
+	// Nobody may be reading any more by the time this is destroyed, so the
+	// last version is freed right away.
+	~rcu_ptr() noexcept {
+		delete m_ptr.load(std::memory_order_relaxed);
+	}
+
+	rcu_ptr(const rcu_ptr&) = delete;
+	rcu_ptr& operator=(const rcu_ptr&) = delete;
+
+	// Takes a snapshot of the current version.
+	snapshot read() const {
+		return snapshot(m_ptr);
+	}
+
+	// Publishes a new version, and retires the old one.
+	void store(std::unique_ptr<T> value) {
+		lock_guard<fair_mutex> lg(m_writer);
+		publish(value.release());
+	}
+
+	// Copies the current version, lets `f` modify the copy, and publishes it.
+	// Writers are serialized, so no update is lost.  If there is no current
+	// version, `f` gets a default constructed one.
+	template<class F>
+	void update(F f) {
+		lock_guard<fair_mutex> lg(m_writer);
+		T* current = m_ptr.load(std::memory_order_relaxed);
+		std::unique_ptr<T> copy(current ? new T(*current) : new T());
+		f(*copy);
+		publish(copy.release());
+	}
+
+private:
+	void publish(T* value) {
+		T* old = m_ptr.exchange(value, std::memory_order_acq_rel);
+		if (old)
+			epoch::retire(old);
+	}
+
+private:
+	std::atomic<T*> m_ptr;
+
+	fair_mutex m_writer;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_RCU_PTR_
\ No newline at end of file
@@ -7,15 +7,19 @@
 #ifndef _IPROG_RECURSIVE_MUTEX_
 #define _IPROG_RECURSIVE_MUTEX_
 
+#include <atomic>
+#include <cstdint>
+
 #include "override_terminate.hpp"
 
+// A recursive mutex built on the parking lot.  The lock word is all that
+// other threads touch; the owner and recursion count belong to the thread
+// holding it.
+
 namespace iprog {
 
 class recursive_mutex
 {
-private:
-	typedef void* native_handle_type;
-
 public:
 	recursive_mutex() noexcept;
 
@@ -35,7 +39,20 @@ public:
 	void unlock();
 
 private:
-	native_handle_type m_handle;
+	void lock_slow(uint32_t state);
+
+	static const uint32_t unlocked = 0;
+	static const uint32_t locked = 1;
+	static const uint32_t locked_contended = 2;
+
+private:
+	std::atomic<uint32_t> m_state{ unlocked };
+
+	// The ID of the owning thread, or zero.  Only ever compared against the
+	// calling thread's own ID, so relaxed accesses are enough.
+	std::atomic<uint32_t> m_owner{ 0 };
+
+	uint32_t m_recursion = 0;
 };
 
 } // namespace iprog
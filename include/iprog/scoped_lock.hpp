@@ -0,0 +1,71 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_SCOPED_LOCK_
+#define _IPROG_SCOPED_LOCK_
+
+#include "lock_tags.hpp"
+#include "lock.hpp"
+
+namespace iprog {
+
+// Owns any number of lockables for the duration of a scope.  They are taken
+// with iprog::lock, so the order they are listed in does not matter.
+template<class... Mutexes>
+class scoped_lock
+{
+public:
+	explicit scoped_lock(Mutexes&... m) : m_refs{ detail::make_lockable_ref(m)... } {
+		detail::lock_all(m_refs, sizeof...(Mutexes));
+	}
+	scoped_lock(adopt_lock_t, Mutexes&... m) noexcept : m_refs{ detail::make_lockable_ref(m)... } {
+		// Assume the caller has ownership of these mutexes already.
+	}
+	~scoped_lock() noexcept {
+		detail::unlock_all(m_refs, sizeof...(Mutexes));
+	}
+	scoped_lock(const scoped_lock&) = delete;
+	scoped_lock& operator=(const scoped_lock&) = delete;
+
+private:
+	detail::lockable_ref m_refs[sizeof...(Mutexes)];
+};
+
+template<class Mutex>
+class scoped_lock<Mutex>
+{
+public:
+	typedef Mutex mutex_type;
+
+	explicit scoped_lock(Mutex& m) : m_mutex(m) {
+		m_mutex.lock();
+	}
+	scoped_lock(adopt_lock_t, Mutex& m) noexcept : m_mutex(m) {
+		// Assume the caller has ownership of this mutex already.
+	}
+	~scoped_lock() noexcept {
+		m_mutex.unlock();
+	}
+	scoped_lock(const scoped_lock&) = delete;
+	scoped_lock& operator=(const scoped_lock&) = delete;
+
+private:
+	Mutex& m_mutex;
+};
+
+template<>
+class scoped_lock<>
+{
+public:
+	explicit scoped_lock() noexcept {}
+	explicit scoped_lock(adopt_lock_t) noexcept {}
+	scoped_lock(const scoped_lock&) = delete;
+	scoped_lock& operator=(const scoped_lock&) = delete;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_SCOPED_LOCK_
\ No newline at end of file
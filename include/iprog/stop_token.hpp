@@ -0,0 +1,279 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_STOP_TOKEN_
+#define _IPROG_STOP_TOKEN_
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <type_traits>
+
+#include "override_terminate.hpp"
+#include "thread.hpp"
+#include "mutex.hpp"
+
+namespace iprog {
+
+class stop_token;
+class stop_source;
+
+struct nostopstate_t { explicit nostopstate_t() = default; };
+
+constexpr nostopstate_t nostopstate{};
+
+namespace detail {
+
+// One registered stop_callback.  Lives inside the stop_callback object itself.
+struct stop_callback_node
+{
+	void (*m_invoke)(void* context) = nullptr;
+	void* m_context = nullptr;
+	stop_callback_node* m_prev = nullptr;
+	stop_callback_node* m_next = nullptr;
+	bool m_linked = false;
+
+	// Set once the callback has returned, when it was run by request_stop().
+	std::atomic<bool> m_done{ false };
+
+	// Points to a flag on request_stop()'s stack while the callback runs, so
+	// that a callback which destroys its own stop_callback can report it.
+	bool* m_destroyed = nullptr;
+};
+
+// The state shared between a stop_source and all of its tokens.
+class stop_state
+{
+public:
+	stop_state() noexcept {}
+
+	stop_state(const stop_state&) = delete;
+	stop_state& operator=(const stop_state&) = delete;
+
+	bool stop_requested() const noexcept {
+		return m_requested.load(std::memory_order_acquire);
+	}
+
+	bool stop_possible() const noexcept {
+		return stop_requested() || m_sources.load(std::memory_order_acquire) != 0;
+	}
+
+	void add_source() noexcept {
+		m_sources.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void remove_source() noexcept {
+		m_sources.fetch_sub(1, std::memory_order_release);
+	}
+
+	// Sets the stop flag and runs every registered callback on this thread.
+	// Returns false if a stop was already requested.
+	bool request_stop();
+
+	// Registers a callback.  Returns false (without registering) if a stop
+	// was already requested, in which case the caller must run it itself.
+	bool add_callback(stop_callback_node* node);
+
+	// Unregisters a callback, waiting for it to finish if it is currently
+	// running on another thread.
+	void remove_callback(stop_callback_node* node);
+
+private:
+	mutex m_mutex;
+
+	std::atomic<bool> m_requested{ false };
+
+	std::atomic<unsigned> m_sources{ 0 };
+
+	stop_callback_node* m_head = nullptr;
+
+	stop_callback_node* m_running = nullptr;
+
+	thread::id m_requester;
+};
+
+} // namespace detail
+
+class stop_token
+{
+public:
+	// Creates a token with no associated stop state.
+	stop_token() noexcept {}
+
+	stop_token(const stop_token& other) noexcept : m_state(other.m_state) {}
+
+	stop_token(stop_token&& other) noexcept : m_state(std::move(other.m_state)) {}
+
+	stop_token& operator=(const stop_token& other) noexcept {
+		m_state = other.m_state;
+		return (*this);
+	}
+
+	stop_token& operator=(stop_token&& other) noexcept {
+		m_state = std::move(other.m_state);
+		return (*this);
+	}
+
+	// Check whether a stop was requested on the associated stop state.
+	bool stop_requested() const noexcept {
+		return m_state && m_state->stop_requested();
+	}
+
+	// Check whether a stop can still be requested, either because it already
+	// was, or because a stop_source still refers to the state.
+	bool stop_possible() const noexcept {
+		return m_state && m_state->stop_possible();
+	}
+
+	void swap(stop_token& other) noexcept {
+		m_state.swap(other.m_state);
+	}
+
+	friend bool operator==(const stop_token& a, const stop_token& b) noexcept {
+		return a.m_state == b.m_state;
+	}
+
+	friend bool operator!=(const stop_token& a, const stop_token& b) noexcept {
+		return a.m_state != b.m_state;
+	}
+
+private:
+	friend class stop_source;
+	template<class Callback>
+	friend class stop_callback;
+
+	explicit stop_token(const std::shared_ptr<detail::stop_state>& state) noexcept : m_state(state) {}
+
+	std::shared_ptr<detail::stop_state> m_state;
+};
+
+class stop_source
+{
+public:
+	// Creates a stop_source with a new stop state.
+	stop_source() : m_state(std::make_shared<detail::stop_state>()) {
+		m_state->add_source();
+	}
+
+	// Creates a stop_source with no associated stop state.
+	explicit stop_source(nostopstate_t) noexcept {}
+
+	stop_source(const stop_source& other) noexcept : m_state(other.m_state) {
+		if (m_state)
+			m_state->add_source();
+	}
+
+	stop_source(stop_source&& other) noexcept : m_state(std::move(other.m_state)) {}
+
+	~stop_source() noexcept {
+		if (m_state)
+			m_state->remove_source();
+	}
+
+	stop_source& operator=(const stop_source& other) noexcept {
+		stop_source(other).swap(*this);
+		return (*this);
+	}
+
+	stop_source& operator=(stop_source&& other) noexcept {
+		stop_source(std::move(other)).swap(*this);
+		return (*this);
+	}
+
+	// Requests a stop.  Registered callbacks run on the calling thread before
+	// this returns.  Returns true if this call made the request.
+	bool request_stop() {
+		return m_state && m_state->request_stop();
+	}
+
+	stop_token get_token() const noexcept {
+		return stop_token(m_state);
+	}
+
+	bool stop_requested() const noexcept {
+		return m_state && m_state->stop_requested();
+	}
+
+	bool stop_possible() const noexcept {
+		return m_state != nullptr;
+	}
+
+	void swap(stop_source& other) noexcept {
+		m_state.swap(other.m_state);
+	}
+
+	friend bool operator==(const stop_source& a, const stop_source& b) noexcept {
+		return a.m_state == b.m_state;
+	}
+
+	friend bool operator!=(const stop_source& a, const stop_source& b) noexcept {
+		return a.m_state != b.m_state;
+	}
+
+private:
+	std::shared_ptr<detail::stop_state> m_state;
+};
+
+// Runs a callback when a stop is requested on the token it was constructed
+// with.  If a stop was already requested, the callback runs in the constructor.
+template<class Callback>
+class stop_callback
+{
+public:
+	typedef Callback callback_type;
+
+	template<class C>
+	explicit stop_callback(const stop_token& st, C&& cb) : m_callback(std::forward<C>(cb)) {
+		attach(st.m_state);
+	}
+
+	template<class C>
+	explicit stop_callback(stop_token&& st, C&& cb) : m_callback(std::forward<C>(cb)) {
+		attach(st.m_state);
+	}
+
+	~stop_callback() noexcept {
+		if (m_state)
+			m_state->remove_callback(&m_node);
+	}
+
+	stop_callback(const stop_callback&) = delete;
+	stop_callback& operator=(const stop_callback&) = delete;
+
+private:
+	void attach(const std::shared_ptr<detail::stop_state>& state) {
+		if (!state)
+			return;
+
+		m_node.m_invoke = &invoke;
+		m_node.m_context = this;
+		if (state->add_callback(&m_node))
+			m_state = state;
+		else
+			m_callback();
+	}
+
+	static void invoke(void* context) {
+		static_cast<stop_callback*>(context)->m_callback();
+	}
+
+private:
+	detail::stop_callback_node m_node;
+	Callback m_callback;
+	std::shared_ptr<detail::stop_state> m_state;
+};
+
+inline void swap(stop_token& a, stop_token& b) noexcept {
+	a.swap(b);
+}
+
+inline void swap(stop_source& a, stop_source& b) noexcept {
+	a.swap(b);
+}
+
+} // namespace iprog
+
+#endif//_IPROG_STOP_TOKEN_
\ No newline at end of file
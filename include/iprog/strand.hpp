@@ -0,0 +1,300 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_STRAND_
+#define _IPROG_STRAND_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "override_terminate.hpp"
+#include "thread.hpp"
+
+// Runs the tasks given to it one at a time, in the order they were given,
+// on whichever threads the underlying executor runs them on.  Use it in place
+// of a mutex around an object whose operations only need to not overlap:
+// callers queue work instead of waiting for each other.
+//
+// Queueing a task never takes a lock.  Whoever queues the first task of an
+// idle strand becomes the one that runs it, along with whatever piles up
+// behind it, either right away with dispatch(), or on the executor with
+// post().
+//
+// The executor can be anything with a post(F) that calls f() later, such as
+// an io_context.
+
+namespace iprog {
+
+namespace detail {
+
+class strand_task
+{
+public:
+	strand_task(const strand_task&) = delete;
+	strand_task& operator=(const strand_task&) = delete;
+
+protected:
+	// Called with `call` false to free the task without running it.
+	typedef void (*complete_function)(strand_task* task, bool call);
+
+	explicit strand_task(complete_function complete) noexcept : m_next(nullptr), m_complete(complete) {}
+
+	~strand_task() {}
+
+private:
+	template<class Executor>
+	friend class strand_state;
+
+	std::atomic<strand_task*> m_next;
+
+	complete_function m_complete;
+};
+
+template<class F>
+class strand_handler_task : public strand_task
+{
+public:
+	explicit strand_handler_task(F&& f) : strand_task(&complete), m_f(std::move(f)) {}
+
+private:
+	// Frees the task before calling it, like io_context does.
+	static void complete(strand_task* base, bool call) {
+		strand_handler_task* self = static_cast<strand_handler_task*>(base);
+		F f(std::move(self->m_f));
+		delete self;
+
+		if (call)
+			f();
+	}
+
+	F m_f;
+};
+
+// The strand that the calling thread is running tasks for, if any.
+void* strand_current() noexcept;
+void strand_set_current(void* state) noexcept;
+
+template<class Executor>
+class strand_state : public std::enable_shared_from_this<strand_state<Executor> >
+{
+public:
+	// How many tasks run in a row before the rest go back to the executor,
+	// so one busy strand can't hold on to a thread, or a caller of
+	// dispatch(), forever.
+	static const size_t batch_size = 32;
+
+	explicit strand_state(Executor& executor) noexcept : m_executor(&executor), m_stub(&free_stub), m_head(&m_stub), m_tail(&m_stub) {}
+
+	// Only reached once nobody is running the strand.  Whatever is left
+	// was never handed to anyone, because the executor dropped our run.
+	~strand_state() {
+		strand_task* task;
+		while (m_pending.load(std::memory_order_acquire) != 0 && (task = pop()) != nullptr) {
+			m_pending.fetch_sub(1, std::memory_order_relaxed);
+			task->m_complete(task, false);
+		}
+	}
+
+	strand_state(const strand_state&) = delete;
+	strand_state& operator=(const strand_state&) = delete;
+
+	Executor& executor() const noexcept {
+		return *m_executor;
+	}
+
+	// Queues a task.  Returns true if the strand was idle, in which case the
+	// caller now owns it and has to see that run() gets called.
+	bool push(strand_task* task) noexcept {
+		task->m_next.store(nullptr, std::memory_order_relaxed);
+		strand_task* prev = m_head.exchange(task, std::memory_order_acq_rel);
+		prev->m_next.store(task, std::memory_order_release);
+
+		return m_pending.fetch_add(1, std::memory_order_acq_rel) == 0;
+	}
+
+	// Runs up to a batch of tasks, as the owner.  If some are left after
+	// that, or a task throws, the rest are handed to the executor, which
+	// then owns the strand.
+	void run() {
+		struct owner_guard
+		{
+			strand_state* m_state;
+			void* m_previous;
+			bool m_owner;
+
+			~owner_guard() {
+				strand_set_current(m_previous);
+				if (m_owner)
+					m_state->schedule();
+			}
+		} guard = { this, strand_current(), true };
+
+		strand_set_current(this);
+
+		for (size_t i = 0; i < batch_size && guard.m_owner; i++) {
+			// The task is off the queue before it runs, so if it throws, it
+			// only needs to be counted off.
+			struct count_guard
+			{
+				owner_guard& m_owner_guard;
+				~count_guard() {
+					strand_state* state = m_owner_guard.m_state;
+					if (state->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+						m_owner_guard.m_owner = false;
+				}
+			} cg = { guard };
+
+			strand_task* task = pop();
+			task->m_complete(task, true);
+		}
+	}
+
+	// Has the executor run the strand for us.  Without that, the tasks
+	// queued so far would never run, so failing to is fatal.
+	void schedule() noexcept;
+
+private:
+	// Only the owner pops.  The count says a task is there, so if its link
+	// isn't, the producer is between its two steps, and will be done soon.
+	strand_task* pop() noexcept {
+		for (;;) {
+			strand_task* tail = m_tail;
+			strand_task* next = tail->m_next.load(std::memory_order_acquire);
+
+			if (tail == &m_stub) {
+				if (!next) {
+					if (m_head.load(std::memory_order_acquire) == &m_stub)
+						return nullptr;
+
+					this_thread::yield();
+					continue;
+				}
+
+				m_tail = next;
+				tail = next;
+				next = tail->m_next.load(std::memory_order_acquire);
+			}
+
+			if (next) {
+				m_tail = next;
+				return tail;
+			}
+
+			// `tail` is the last task we know of.  Put the stub behind it, so
+			// it can be taken without losing the end of the queue.
+			if (m_head.load(std::memory_order_acquire) == tail) {
+				m_stub.m_next.store(nullptr, std::memory_order_relaxed);
+				strand_task* prev = m_head.exchange(&m_stub, std::memory_order_acq_rel);
+				prev->m_next.store(&m_stub, std::memory_order_release);
+			}
+
+			next = tail->m_next.load(std::memory_order_acquire);
+			if (next) {
+				m_tail = next;
+				return tail;
+			}
+
+			this_thread::yield();
+		}
+	}
+
+	static void free_stub(strand_task*, bool) {}
+
+	struct run_handler
+	{
+		std::shared_ptr<strand_state> m_state;
+
+		void operator()() {
+			m_state->run();
+		}
+	};
+
+	Executor* m_executor;
+
+	strand_task m_stub;
+
+	// Producers swap themselves in at the head.  The owner takes from the
+	// tail.
+	std::atomic<strand_task*> m_head;
+	strand_task* m_tail;
+
+	// Tasks queued but not yet run.  Nonzero means someone owns the strand.
+	std::atomic<size_t> m_pending{ 0 };
+};
+
+template<class Executor>
+void strand_state<Executor>::schedule() noexcept {
+	try
+	{
+		run_handler handler = { this->shared_from_this() };
+		m_executor->post(std::move(handler));
+	}
+	catch (...)
+	{
+		terminateIprogsThreads();
+	}
+}
+
+} // namespace detail
+
+template<class Executor>
+class strand
+{
+public:
+	explicit strand(Executor& executor) : m_state(std::make_shared<detail::strand_state<Executor> >(executor)) {}
+
+	// Copies run tasks on the same strand.
+	strand(const strand&) = default;
+	strand& operator=(const strand&) = default;
+
+	Executor& get_inner_executor() const noexcept {
+		return m_state->executor();
+	}
+
+	// Check whether the calling thread is running one of this strand's tasks.
+	bool running_in_this_thread() const noexcept {
+		return detail::strand_current() == m_state.get();
+	}
+
+	// Calls f() on the executor, after every task queued before it.
+	template<class F>
+	void post(F f) {
+		if (m_state->push(new detail::strand_handler_task<F>(std::move(f))))
+			m_state->schedule();
+	}
+
+	// Calls f() right away if that doesn't break the order: from inside one
+	// of this strand's tasks, or when the strand is idle.  In the latter
+	// case, tasks queued meanwhile run here too, up to a batch.  Otherwise,
+	// it's like post().
+	template<class F>
+	void dispatch(F f) {
+		if (running_in_this_thread()) {
+			f();
+			return;
+		}
+
+		if (m_state->push(new detail::strand_handler_task<F>(std::move(f))))
+			m_state->run();
+	}
+
+	friend bool operator==(const strand& a, const strand& b) noexcept {
+		return a.m_state == b.m_state;
+	}
+
+	friend bool operator!=(const strand& a, const strand& b) noexcept {
+		return a.m_state != b.m_state;
+	}
+
+private:
+	std::shared_ptr<detail::strand_state<Executor> > m_state;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_STRAND_
\ No newline at end of file
@@ -0,0 +1,224 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_STRIPED_MUTEX_
+#define _IPROG_STRIPED_MUTEX_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <new>
+
+#include "override_terminate.hpp"
+#include "fair_mutex.hpp"
+#include "unique_lock.hpp"
+
+// A fixed set of N locks that keys are hashed onto, for locking "this
+// message" or "this path" without a mutex per key.  Two keys that land on
+// the same stripe share a lock, which is only ever too much locking, never
+// too little.  Each stripe is a fair_mutex on its own cache line, so stripes
+// don't slow each other down, and there is nothing to allocate per key.
+//
+// To hold several keys at once, gather them in a stripe_set, which takes its
+// stripes in index order, so two sets can't deadlock against each other.
+
+namespace iprog {
+
+template<size_t N = 64>
+class striped_mutex
+{
+private:
+	static const size_t cache_line = 64;
+
+	struct alignas(cache_line) stripe
+	{
+		fair_mutex m_mutex;
+
+		explicit stripe(uint32_t handoff_after_us) noexcept : m_mutex(handoff_after_us) {}
+	};
+
+	static const size_t word_bits = 64;
+	static const size_t word_count = (N + word_bits - 1) / word_bits;
+
+public:
+	static_assert(N > 0, "a striped_mutex needs at least one stripe");
+
+	static const size_t stripe_count = N;
+
+	// `handoff_after_us` is passed on to every stripe.  The default lets a
+	// busy stripe change hands without a full handoff every time, while
+	// still keeping anyone from waiting on it forever.
+	explicit striped_mutex(uint32_t handoff_after_us = 1000) {
+		// new[] doesn't promise more than the default alignment before C++17,
+		// so line the stripes up by hand.
+		m_raw = new char[N * sizeof(stripe) + cache_line];
+		uintptr_t aligned = (reinterpret_cast<uintptr_t>(m_raw) + cache_line - 1) & ~uintptr_t(cache_line - 1);
+		m_stripes = reinterpret_cast<stripe*>(aligned);
+
+		for (size_t i = 0; i < N; i++)
+			new (&m_stripes[i]) stripe(handoff_after_us);
+	}
+
+	~striped_mutex() noexcept {
+		for (size_t i = 0; i < N; i++)
+			m_stripes[i].~stripe();
+		delete[] m_raw;
+	}
+
+	striped_mutex(const striped_mutex&) = delete;
+	striped_mutex& operator=(const striped_mutex&) = delete;
+
+	// Mixes the hash first, since std::hash is the identity for integers on
+	// most implementations.
+	static size_t index_of(size_t hash) noexcept {
+		uint64_t h = uint64_t(hash);
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return size_t(h % N);
+	}
+
+	fair_mutex& stripe_at(size_t index) noexcept {
+		return m_stripes[index].m_mutex;
+	}
+
+	fair_mutex& mutex_for_hash(size_t hash) noexcept {
+		return stripe_at(index_of(hash));
+	}
+
+	// Several stripes, which can be locked as one, such as with unique_lock.
+	// Adding the same stripe twice is fine, it's only locked once.
+	class stripe_set
+	{
+	public:
+		explicit stripe_set(striped_mutex& owner) noexcept : m_owner(&owner) {
+			for (size_t i = 0; i < word_count; i++)
+				m_bits[i] = 0;
+		}
+
+		// Only while it's unlocked.
+		void add_hash(size_t hash) noexcept {
+			size_t index = index_of(hash);
+			m_bits[index / word_bits] |= uint64_t(1) << (index % word_bits);
+		}
+
+		// If a stripe fails to lock, the ones already taken are let go
+		// before the error is passed on.
+		void lock() {
+			size_t i = next(0);
+			try
+			{
+				for (; i < N; i = next(i + 1))
+					m_owner->stripe_at(i).lock();
+			}
+			catch (...)
+			{
+				unlock_below(i);
+				throw;
+			}
+		}
+
+		// Either takes every stripe, or none.
+		bool try_lock() {
+			for (size_t i = next(0); i < N; i = next(i + 1)) {
+				if (!m_owner->stripe_at(i).try_lock()) {
+					unlock_below(i);
+					return false;
+				}
+			}
+			return true;
+		}
+
+		void unlock() {
+			unlock_below(N);
+		}
+
+	private:
+		// The first stripe in the set at or after `index`, or N if none.
+		// Skips empty words, so a small set in a big table is cheap.
+		size_t next(size_t index) const noexcept {
+			while (index < N) {
+				uint64_t word = m_bits[index / word_bits] >> (index % word_bits);
+				if (!word) {
+					index = (index / word_bits + 1) * word_bits;
+					continue;
+				}
+
+				while (!(word & 1)) {
+					word >>= 1;
+					index++;
+				}
+				return index;
+			}
+			return N;
+		}
+
+		void unlock_below(size_t end) {
+			for (size_t i = next(0); i < end; i = next(i + 1))
+				m_owner->stripe_at(i).unlock();
+		}
+
+		striped_mutex* m_owner;
+		uint64_t m_bits[word_count];
+	};
+
+private:
+	char* m_raw;
+	stripe* m_stripes;
+};
+
+// A striped_mutex that hashes the keys itself.
+template<class Key, size_t N = 64, class Hash = std::hash<Key> >
+class lock_table
+{
+public:
+	typedef typename striped_mutex<N>::stripe_set stripe_set;
+
+	explicit lock_table(uint32_t handoff_after_us = 1000, const Hash& hash = Hash()) : m_stripes(handoff_after_us), m_hash(hash) {}
+
+	lock_table(const lock_table&) = delete;
+	lock_table& operator=(const lock_table&) = delete;
+
+	fair_mutex& mutex_for(const Key& key) {
+		return m_stripes.mutex_for_hash(m_hash(key));
+	}
+
+	unique_lock<fair_mutex> lock(const Key& key) {
+		return unique_lock<fair_mutex>(mutex_for(key));
+	}
+
+	// Check owns_lock() on the result.
+	unique_lock<fair_mutex> try_lock(const Key& key) {
+		return unique_lock<fair_mutex>(mutex_for(key), try_to_lock);
+	}
+
+	// The stripes for every key in [first, last), to lock together:
+	//
+	//     auto keys = table.stripes_for(ids.begin(), ids.end());
+	//     unique_lock<lock_table<int>::stripe_set> lk(keys);
+	template<class It>
+	stripe_set stripes_for(It first, It last) {
+		stripe_set set(m_stripes);
+		for (; first != last; ++first)
+			set.add_hash(m_hash(*first));
+		return set;
+	}
+
+	stripe_set stripes_for(std::initializer_list<Key> keys) {
+		return stripes_for(keys.begin(), keys.end());
+	}
+
+private:
+	striped_mutex<N> m_stripes;
+	Hash m_hash;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_STRIPED_MUTEX_
\ No newline at end of file
@@ -7,6 +7,7 @@
 #ifndef _IPROG_THREAD_
 #define _IPROG_THREAD_
 
+#include <cstdint>
 #include <functional>
 #include <type_traits>
 #include <tuple>
@@ -17,6 +18,8 @@
 
 #include "override_terminate.hpp"
 #include "w32constants.hpp"
+#include "trace.hpp"
+#include "ticks.hpp"
 
 #ifdef _DEBUG
 extern void DbgPrintW(const char* fmt, ...);
@@ -26,6 +29,18 @@ extern void DbgPrintW(const char* fmt, ...);
 
 namespace iprog {
 
+namespace detail {
+
+// Functions which release per-thread state kept by the library.  They run on
+// a thread started by iprog::thread, just before it exits.
+typedef void (*thread_exit_hook)();
+
+void add_thread_exit_hook(thread_exit_hook hook) noexcept;
+
+void run_thread_exit_hooks() noexcept;
+
+} // namespace detail
+
 class this_thread;
 
 class thread
@@ -100,6 +115,7 @@ public:
 	thread() noexcept {
 		m_handle = nullptr;
 		m_id = 0;
+		m_cached = nullptr;
 	}
 
 	// Destroys the thread object.  It may not have an associated thread.
@@ -114,8 +130,10 @@ public:
 	thread(thread&& other) noexcept {
 		m_handle = other.m_handle;
 		m_id = other.m_id;
+		m_cached = other.m_cached;
 		other.m_handle = nullptr;
 		other.m_id = 0;
+		other.m_cached = nullptr;
 	}
 
 	thread& operator=(thread&& other) noexcept {
@@ -124,8 +142,10 @@ public:
 
 		m_handle = other.m_handle;
 		m_id = other.m_id;
+		m_cached = other.m_cached;
 		other.m_handle = nullptr;
 		other.m_id = id(0);
+		other.m_cached = nullptr;
 		return (*this);
 	}
 
@@ -161,19 +181,35 @@ public:
 	void swap(thread& other) noexcept {
 		std::swap(m_handle, other.m_handle);
 		std::swap(m_id, other.m_id);
+		std::swap(m_cached, other.m_cached);
 	}
 	
 	static unsigned int hardware_concurrency() noexcept;
+
+	// Keeps up to `max_idle` OS threads around after their function returns
+	// and the thread object is joined or detached, and uses them to run the
+	// functions of later thread objects instead of creating new threads.  0
+	// (the default) turns this off, and lets any idle threads exit.
+	//
+	// A cached thread keeps its thread ID and any C++ thread_local values
+	// between functions, and its native_handle() is only signalled once the
+	// underlying OS thread really exits, so join() is the way to wait for it.
+	static void set_cache_limit(unsigned max_idle) noexcept;
 	
 private:
 	// Template based black magic.
 	template<class Tuple, size_t... Indices>
 	static void __stdcall invoke(void* params) noexcept {
 		// This is the beginning function of the thread.
-		const std::unique_ptr<Tuple> vals_ptr(static_cast<Tuple*>(params));
-		Tuple& vals = *vals_ptr.get();
-		// Note. I'd use std::invoke here, but that didn't come out until C++14. Bummer.
-		std::bind(std::move(std::get<Indices>(vals))...)();
+		trace::record(trace_event::thread_start, nullptr);
+		{
+			const std::unique_ptr<Tuple> vals_ptr(static_cast<Tuple*>(params));
+			Tuple& vals = *vals_ptr.get();
+			// Note. I'd use std::invoke here, but that didn't come out until C++14. Bummer.
+			std::bind(std::move(std::get<Indices>(vals))...)();
+		}
+		trace::record(trace_event::thread_exit, nullptr);
+		detail::run_thread_exit_hooks();
 	}
 	
 	template<class Tuple, size_t... Indices>
@@ -188,7 +224,8 @@ private:
 		auto invoker_func = get_invoker<start_data_tuple>(make_idx_seq<1 + sizeof...(Args)>{});
 
 		size_t tid = 0;
-		m_handle = create_thread(invoker_func, decay_copied.get(), tid);
+		m_cached = nullptr;
+		m_handle = create_thread(invoker_func, decay_copied.get(), tid, m_cached);
 		m_id = id(tid);
 		if (m_handle) {
 			(void) decay_copied.release();
@@ -198,17 +235,23 @@ private:
 		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
 	}
 
-	static native_handle_type create_thread(void* invokeptr, void* params, size_t& out_id) noexcept;
+	static native_handle_type create_thread(void* invokeptr, void* params, size_t& out_id, void*& out_cached) noexcept;
 
 private:
 	native_handle_type m_handle;
 	id m_id;
+
+	// The cached OS thread running our function, if it came from the cache.
+	void* m_cached;
 };
 
 class this_thread
 {
 public:
 	static thread::id get_id() noexcept;
+
+	// Gives up the rest of this thread's time slice.
+	static void yield() noexcept;
 	
 	template<class Rep, class Period>
 	static void sleep_for(const std::chrono::duration<Rep, Period>& sleep_duration) {
@@ -228,9 +271,49 @@ public:
 	static void sleep_until(const std::chrono::time_point<Clock, Duration>& sleep_time) {
 		sleep_for(sleep_time - Clock::now());
 	}
+
+	// Sleeps with sub-millisecond accuracy.  Most of the time is spent in an
+	// ordinary OS sleep, until the time left is about what one OS sleep tends
+	// to overshoot by (which is measured as we go) plus `spin_budget`.  The
+	// rest is spent spinning and yielding the time slice.  A bigger budget
+	// costs more CPU, but makes waking up late less likely.
+	template<class Rep, class Period>
+	static void sleep_for_precise(const std::chrono::duration<Rep, Period>& sleep_duration,
+		std::chrono::microseconds spin_budget = std::chrono::microseconds(500)) {
+		perform_precise_sleep(detail::to_nanoseconds(sleep_duration), detail::to_nanoseconds(spin_budget));
+	}
+
+	template<class Clock, class Duration>
+	static void sleep_until_precise(const std::chrono::time_point<Clock, Duration>& sleep_time,
+		std::chrono::microseconds spin_budget = std::chrono::microseconds(500)) {
+		sleep_for_precise(sleep_time - Clock::now(), spin_budget);
+	}
+
+	// Sleeps for at least `sleep_duration`, and lets the wakeup come up to
+	// `slack` later, so that it can be batched with other timers instead of
+	// waking the CPU on its own.  From Windows 7 on this is a waitable timer
+	// with that much tolerable delay, rounded down to whole milliseconds.
+	// Before that, or with less than a millisecond of slack, it is only best
+	// effort: the deadline is rounded up to the next multiple of `slack` on
+	// the performance counter and slept for with Sleep().
+	template<class Rep, class Period, class SRep, class SPeriod>
+	static void sleep_for_coalescable(const std::chrono::duration<Rep, Period>& sleep_duration,
+		const std::chrono::duration<SRep, SPeriod>& slack) {
+		perform_coalescable_sleep(detail::to_nanoseconds(sleep_duration), detail::to_nanoseconds(slack));
+	}
+
+	template<class Clock, class Duration, class SRep, class SPeriod>
+	static void sleep_until_coalescable(const std::chrono::time_point<Clock, Duration>& sleep_time,
+		const std::chrono::duration<SRep, SPeriod>& slack) {
+		sleep_for_coalescable(sleep_time - Clock::now(), slack);
+	}
 	
 private:
 	static void perform_sleep(uint32_t ms) noexcept;
+
+	static void perform_precise_sleep(int64_t ns, int64_t spin_budget_ns) noexcept;
+
+	static void perform_coalescable_sleep(int64_t ns, int64_t slack_ns) noexcept;
 };
 
 } // namespace iprog
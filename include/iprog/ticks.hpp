@@ -0,0 +1,47 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_TICKS_
+#define _IPROG_TICKS_
+
+#include <chrono>
+#include <cstdint>
+
+// Internal helpers for timing with the performance counter, shared by
+// everything that measures or waits for short intervals, and for passing
+// durations from templates in headers down to it.
+
+namespace iprog {
+
+namespace detail {
+
+// Performance counter ticks per second.  Safe to call from static
+// initializers in any translation unit.
+int64_t tick_frequency() noexcept;
+
+// Never zero, so it can be divided by.
+int64_t ticks_per_ms() noexcept;
+
+int64_t now_ticks() noexcept;
+
+int64_t ns_to_ticks(int64_t ns) noexcept;
+
+// Clamped to [0, ~285 years], so that duration::max() doesn't overflow.
+template<class Rep, class Period>
+int64_t to_nanoseconds(const std::chrono::duration<Rep, Period>& d) {
+	double ns = std::chrono::duration_cast<std::chrono::duration<double, std::nano> >(d).count();
+	if (ns <= 0)
+		return 0;
+	if (ns >= 9.0e18)
+		return INT64_C(9000000000000000000);
+	return (int64_t) ns;
+}
+
+} // namespace detail
+
+} // namespace iprog
+
+#endif//_IPROG_TICKS_
\ No newline at end of file
@@ -0,0 +1,85 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#ifndef _IPROG_TRACE_
+#define _IPROG_TRACE_
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+
+#include "override_terminate.hpp"
+
+// Opt-in event tracing.  While tracing is enabled, threads, mutexes, condition
+// variables and sleeps record timestamped events into a ring buffer owned by
+// the calling thread.  Recording takes no locks.  The events can be exported
+// as Chrome trace JSON, which chrome://tracing and Perfetto both open.
+//
+// While disabled, every instrumented call site costs one relaxed load and a
+// branch.
+
+namespace iprog {
+
+enum class trace_event : uint8_t {
+	thread_start,
+	thread_exit,
+	lock_wait,     // about to block on a mutex
+	lock_acquired,
+	lock_released,
+	cv_wait,       // about to block on a condition variable
+	cv_wake,       // arg: 1 if the wait timed out
+	cv_notify,     // arg: how many waiters were woken
+	sleep_begin,   // arg: requested nanoseconds
+	sleep_end,
+};
+
+class trace
+{
+public:
+	// How many events each thread keeps.  Older ones are overwritten.
+	static const size_t events_per_thread = 8192;
+
+	// How many exited threads' events are kept around until they are
+	// exported.  Past that, new threads take over the buffers of the ones
+	// that exited first.
+	static const size_t exited_threads_kept = 16;
+
+	static void enable() noexcept;
+
+	static void disable() noexcept;
+
+	static bool enabled() noexcept {
+		return s_enabled.load(std::memory_order_relaxed);
+	}
+
+	// Names the calling thread in exported traces.  Can be called before
+	// tracing is enabled.
+	static void set_thread_name(const char* name);
+
+	// Records an event on the calling thread, if tracing is enabled.
+	static void record(trace_event event, const void* object, uint64_t arg = 0) noexcept {
+		if (enabled())
+			record_slow(event, object, arg);
+	}
+
+	// Forgets every event recorded so far.
+	static void clear();
+
+	// Writes every event still held by any thread, including ones that have
+	// exited since, as Chrome trace JSON.  Threads that had exited by then
+	// may have their events handed to new threads afterwards, so a second
+	// export is not guaranteed to include them again.
+	static void export_chrome_json(std::ostream& os);
+
+private:
+	static void record_slow(trace_event event, const void* object, uint64_t arg) noexcept;
+
+	static std::atomic<bool> s_enabled;
+};
+
+} // namespace iprog
+
+#endif//_IPROG_TRACE_
\ No newline at end of file
@@ -6,48 +6,34 @@
 
 #include <iprog/condition_variable.hpp>
 
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
+#include <iprog/parking_lot.hpp>
 
 namespace iprog {
 
-condition_variable_any::condition_variable_any()
+void condition_variable_any::notify_all() noexcept
 {
-	m_semaphore = (native_handle) CreateSemaphore(NULL, 0, 0xFFFF, NULL);
-	if (!m_semaphore) {
-		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
-	}
-
-	m_wake_event = (native_handle) CreateEvent(NULL, FALSE, FALSE, NULL);
-	if (!m_wake_event) {
-		CloseHandle(m_semaphore);
-		m_semaphore = nullptr;
-		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
-	}
-}
+	m_signal.fetch_add(1, std::memory_order_seq_cst);
 
-condition_variable_any::~condition_variable_any()
-{
-	if (m_semaphore)
-		CloseHandle(m_semaphore);
-	if (m_wake_event)
-		CloseHandle(m_wake_event);
+	size_t woken = parking_lot::unpark_all(&m_signal);
+	if (woken)
+		trace::record(trace_event::cv_notify, this, (uint64_t) woken);
 }
 
-uint32_t condition_variable_any::wait_object(native_handle sem, uint32_t timeout)
+void condition_variable_any::notify_one() noexcept
 {
-	DWORD res = WaitForSingleObject((HANDLE) sem, (DWORD) timeout);
-	return (uint32_t) res;
-}
+	m_signal.fetch_add(1, std::memory_order_seq_cst);
 
-bool condition_variable_any::set_event(native_handle ev)
-{
-	return SetEvent((HANDLE) ev) != FALSE;
+	if (parking_lot::unpark_one(&m_signal).unparked_thread)
+		trace::record(trace_event::cv_notify, this, 1);
 }
 
-bool condition_variable_any::release_sem(native_handle sem, long count, long* prev_count)
+bool condition_variable_any::wait_signal(uint32_t seen, uint32_t timeout)
 {
-	return ReleaseSemaphore((HANDLE) sem, (LONG) count, (LPLONG) prev_count) != FALSE;
+	park_result result = parking_lot::park_for(&m_signal, [this, seen]() {
+		return m_signal.load(std::memory_order_relaxed) == seen;
+	}, timeout);
+
+	return result.status != park_status::timed_out;
 }
 
 } // namespace iprog
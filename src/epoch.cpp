@@ -0,0 +1,244 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <atomic>
+#include <vector>
+#include <system_error>
+
+#include <iprog/epoch.hpp>
+#include <iprog/thread.hpp>
+#include <iprog/fair_mutex.hpp>
+#include <iprog/lock_guard.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+namespace iprog {
+
+struct retired_object
+{
+	void* m_object;
+	void (*m_deleter)(void*);
+	uint64_t m_epoch;
+};
+
+// Per-thread epoch state.  Records are never freed.  When a thread exits, its
+// record is released for the next thread that needs one.
+struct epoch_record
+{
+	// (epoch << 1) | 1 while the owning thread is pinned, 0 otherwise.
+	std::atomic<uint64_t> m_state{ 0 };
+
+	// Only touched by the owning thread.
+	unsigned m_nesting = 0;
+	std::vector<retired_object> m_retired;
+	size_t m_collect_at = 0;
+
+	std::atomic<bool> m_in_use{ true };
+	epoch_record* m_next = nullptr;
+};
+
+// How many objects a thread retires before it tries to free some.
+static const size_t collect_threshold = 64;
+
+static std::atomic<uint64_t> s_epoch{ 0 };
+
+static std::atomic<epoch_record*> s_records{ nullptr };
+
+static DWORD s_record_slot = TlsAlloc();
+
+// Objects retired by threads that have since exited.
+static fair_mutex s_orphan_mutex;
+static std::vector<retired_object> s_orphans;
+
+static void release_record()
+{
+	epoch_record* rec = (epoch_record*) TlsGetValue(s_record_slot);
+	if (!rec)
+		return;
+
+	rec->m_nesting = 0;
+	rec->m_state.store(0, std::memory_order_release);
+
+	if (!rec->m_retired.empty()) {
+		lock_guard<fair_mutex> lg(s_orphan_mutex);
+		s_orphans.insert(s_orphans.end(), rec->m_retired.begin(), rec->m_retired.end());
+	}
+	rec->m_retired.clear();
+	rec->m_collect_at = 0;
+
+	TlsSetValue(s_record_slot, nullptr);
+	rec->m_in_use.store(false, std::memory_order_release);
+}
+
+static bool s_hook_added = (detail::add_thread_exit_hook(&release_record), true);
+
+static epoch_record* current_record()
+{
+	if (s_record_slot == TLS_OUT_OF_INDEXES)
+		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+
+	epoch_record* rec = (epoch_record*) TlsGetValue(s_record_slot);
+	if (rec)
+		return rec;
+
+	// Take over a record left behind by a thread that exited, if any.
+	for (rec = s_records.load(std::memory_order_acquire); rec; rec = rec->m_next) {
+		bool expected = false;
+		if (!rec->m_in_use.load(std::memory_order_relaxed) &&
+			rec->m_in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+			break;
+	}
+
+	if (!rec) {
+		rec = new epoch_record;
+		epoch_record* head = s_records.load(std::memory_order_relaxed);
+		do
+			rec->m_next = head;
+		while (!s_records.compare_exchange_weak(head, rec, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	rec->m_collect_at = collect_threshold;
+	TlsSetValue(s_record_slot, rec);
+	return rec;
+}
+
+// Moves the global epoch forward if every pinned thread has seen the current
+// one.  Returns whether the epoch is now past the one we started with.
+static bool try_advance()
+{
+	uint64_t current = s_epoch.load(std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	for (epoch_record* rec = s_records.load(std::memory_order_acquire); rec; rec = rec->m_next) {
+		uint64_t state = rec->m_state.load(std::memory_order_relaxed);
+		if ((state & 1) && (state >> 1) != current)
+			return false;
+	}
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	s_epoch.compare_exchange_strong(current, current + 1, std::memory_order_release, std::memory_order_relaxed);
+	return true;
+}
+
+// Frees everything in `list` that was retired at least two epochs ago.  The
+// deleters run after the list is put back together, since they may retire
+// more objects themselves.
+static void free_safe(std::vector<retired_object>& list)
+{
+	uint64_t current = s_epoch.load(std::memory_order_acquire);
+
+	std::vector<retired_object> safe;
+	size_t kept = 0;
+	for (size_t i = 0; i < list.size(); i++) {
+		if (list[i].m_epoch + 2 <= current)
+			safe.push_back(list[i]);
+		else
+			list[kept++] = list[i];
+	}
+	list.resize(kept);
+
+	for (size_t i = 0; i < safe.size(); i++)
+		safe[i].m_deleter(safe[i].m_object);
+}
+
+static void collect_orphans()
+{
+	std::vector<retired_object> orphans;
+	{
+		lock_guard<fair_mutex> lg(s_orphan_mutex);
+		if (s_orphans.empty())
+			return;
+		orphans.swap(s_orphans);
+	}
+
+	free_safe(orphans);
+	if (orphans.empty())
+		return;
+
+	lock_guard<fair_mutex> lg(s_orphan_mutex);
+	s_orphans.insert(s_orphans.end(), orphans.begin(), orphans.end());
+}
+
+void epoch::enter()
+{
+	epoch_record* rec = current_record();
+	if (rec->m_nesting++ != 0)
+		return;
+
+	// Publish which epoch we are reading in, then make sure that is visible
+	// before any of our loads from shared objects.
+	uint64_t current = s_epoch.load(std::memory_order_relaxed);
+	rec->m_state.store((current << 1) | 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void epoch::leave() noexcept
+{
+	epoch_record* rec = (epoch_record*) TlsGetValue(s_record_slot);
+	if (!rec || rec->m_nesting == 0)
+		terminateIprogsThreads();
+
+	if (--rec->m_nesting == 0)
+		rec->m_state.store(0, std::memory_order_release);
+}
+
+bool epoch::is_pinned() noexcept
+{
+	if (s_record_slot == TLS_OUT_OF_INDEXES)
+		return false;
+
+	epoch_record* rec = (epoch_record*) TlsGetValue(s_record_slot);
+	return rec && rec->m_nesting != 0;
+}
+
+void epoch::retire(void* object, void (*deleter)(void*))
+{
+	epoch_record* rec = current_record();
+
+	// The object was unlinked before this point, so anyone who pins from the
+	// epoch read here on can't have seen it.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	retired_object ro = { object, deleter, s_epoch.load(std::memory_order_relaxed) };
+	rec->m_retired.push_back(ro);
+
+	if (rec->m_retired.size() < rec->m_collect_at)
+		return;
+
+	try_advance();
+	free_safe(rec->m_retired);
+	collect_orphans();
+
+	// Back off if most of it couldn't be freed yet, so a long-pinned reader
+	// doesn't make every retire rescan the whole list.
+	rec->m_collect_at = rec->m_retired.size() + collect_threshold;
+}
+
+void epoch::collect()
+{
+	epoch_record* rec = current_record();
+	try_advance();
+	free_safe(rec->m_retired);
+	collect_orphans();
+	rec->m_collect_at = rec->m_retired.size() + collect_threshold;
+}
+
+void epoch::synchronize()
+{
+	if (is_pinned())
+		throw std::system_error(std::make_error_code(std::errc::resource_deadlock_would_occur));
+
+	// Anything retired so far is safe two epochs from now.
+	uint64_t target = s_epoch.load(std::memory_order_acquire) + 2;
+	while (s_epoch.load(std::memory_order_acquire) < target) {
+		if (!try_advance())
+			this_thread::yield();
+	}
+
+	collect();
+}
+
+} // namespace iprog
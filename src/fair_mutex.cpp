@@ -0,0 +1,88 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <iprog/fair_mutex.hpp>
+#include <iprog/parking_lot.hpp>
+#include <iprog/thread.hpp>
+#include <iprog/ticks.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+namespace iprog {
+
+// Passed to a woken thread when the mutex was handed straight to it.
+static const intptr_t handoff_token = 1;
+
+// How often to retry before parking, while nobody is parked yet.
+static const unsigned spin_limit = 40;
+
+void fair_mutex::lock_slow()
+{
+	unsigned spins = 0;
+	for (;;) {
+		uint8_t state = m_state.load(std::memory_order_relaxed);
+
+		// Free, so take it.  With strict handoff this only happens when
+		// nobody is parked, since unlock never clears the bit for a waiter.
+		if (!(state & locked_bit)) {
+			if (m_state.compare_exchange_weak(state, state | locked_bit, std::memory_order_acquire, std::memory_order_relaxed))
+				return;
+			continue;
+		}
+
+		// Held, but nobody is queued yet.  The owner may be about to let go.
+		if (!(state & parked_bit) && spins < spin_limit) {
+			spins++;
+			this_thread::yield();
+			continue;
+		}
+
+		if (!(state & parked_bit)) {
+			if (!m_state.compare_exchange_weak(state, state | parked_bit, std::memory_order_relaxed, std::memory_order_relaxed))
+				continue;
+		}
+
+		park_result result = parking_lot::park(&m_state, [this]() {
+			return m_state.load(std::memory_order_relaxed) == (locked_bit | parked_bit);
+		});
+
+		// The unlocking thread left the mutex locked on our behalf.
+		if (result.status == park_status::unparked && result.token == handoff_token)
+			return;
+	}
+}
+
+void fair_mutex::unlock_slow()
+{
+	parking_lot::unpark_one(&m_state, [this](unpark_result result) -> intptr_t {
+		if (!result.unparked_thread) {
+			m_state.store(0, std::memory_order_release);
+			return 0;
+		}
+
+		bool handoff = true;
+		if (m_handoff_us) {
+			int64_t now = detail::now_ticks();
+			handoff = now >= m_next_handoff;
+			if (handoff)
+				m_next_handoff = now + int64_t(m_handoff_us) * detail::tick_frequency() / 1000000;
+		}
+
+		uint8_t parked = result.have_more_threads ? parked_bit : 0;
+		if (handoff) {
+			// Stay locked, ownership goes to the woken thread.
+			m_state.store(locked_bit | parked, std::memory_order_relaxed);
+			return handoff_token;
+		}
+
+		// Let the woken thread race for it with everyone else.
+		m_state.store(parked, std::memory_order_release);
+		return 0;
+	});
+}
+
+} // namespace iprog
@@ -0,0 +1,542 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <atomic>
+#include <system_error>
+#include <vector>
+
+#include <iprog/fiber.hpp>
+#include <iprog/thread.hpp>
+#include <iprog/lock_guard.hpp>
+#include <iprog/parking_lot.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+namespace iprog {
+
+// How many fibers a worker takes from its own queue in a row before it looks
+// at the shared one first, so that new fibers still get started while pinned
+// ones keep it busy.
+static const unsigned shared_check_interval = 61;
+
+// Fibers ready to run, oldest first.
+struct fiber_ready_queue
+{
+	fair_mutex m_mutex;
+	detail::fiber_context* m_head = nullptr;
+	detail::fiber_context* m_tail = nullptr;
+
+	// Bumped whenever a fiber is made ready for the queue's worker, so it
+	// can tell whether it missed one while going to sleep.
+	std::atomic<uint32_t> m_signal{ 0 };
+
+	// Set while the worker is asleep, or about to be.  Whoever clears it
+	// has to wake the worker.
+	std::atomic<bool> m_sleeping{ false };
+
+	// Keeps neighbouring queues' locks off this one's cache line.  new[]
+	// won't honour alignas before C++17, so this is padding instead.
+	char m_padding[64];
+};
+
+struct detail::fiber_context
+{
+	void* m_handle = nullptr;
+	fiber_scheduler_state* m_scheduler = nullptr;
+
+	// Until the fiber starts running it.
+	fiber_function* m_function = nullptr;
+
+	// One for the fiber object, one for the fiber itself.
+	std::atomic<int> m_refs{ 2 };
+
+	// The queue of the worker that first ran the fiber, which runs it from
+	// then on.  Null until it has started.
+	fiber_ready_queue* m_home = nullptr;
+
+	// Links the fiber into a ready queue.
+	fiber_context* m_next_ready = nullptr;
+
+	fair_mutex m_join_mutex;
+	bool m_done = false;
+	fiber_wait_list m_joiners;
+};
+
+struct detail::fiber_scheduler_state
+{
+	~fiber_scheduler_state() {
+		delete[] m_queues;
+	}
+
+	size_t m_stack_size = 0;
+
+	// One per worker, and after them, a shared one for fibers that haven't
+	// started yet, which any worker can take from.
+	fiber_ready_queue* m_queues = nullptr;
+	unsigned m_worker_count = 0;
+
+	// Bumped whenever a fiber is put on the shared queue.
+	std::atomic<uint32_t> m_shared_signal{ 0 };
+
+	// Where to start looking for a sleeping worker, so it isn't always the
+	// first one that gets woken.
+	std::atomic<unsigned> m_wake_start{ 0 };
+
+	// Fibers started that haven't finished yet.
+	std::atomic<size_t> m_live{ 0 };
+
+	std::atomic<bool> m_stopping{ false };
+
+	std::vector<thread> m_workers;
+};
+
+// What a worker thread knows about itself.
+struct fiber_worker
+{
+	// The worker's own fiber, which it runs the scheduling loop on.
+	void* m_main = nullptr;
+
+	detail::fiber_scheduler_state* m_scheduler = nullptr;
+	fiber_ready_queue* m_queue = nullptr;
+
+	// Fibers picked so far, for shared_check_interval.
+	unsigned m_picks = 0;
+
+	detail::fiber_context* m_current = nullptr;
+
+	// Run on the worker's own fiber right after the current fiber switches
+	// back to it.  This is how a fiber that is going to sleep gets to let go
+	// of things only once it is really off its stack.
+	void (*m_after_switch)(void*) = nullptr;
+	void* m_after_switch_arg = nullptr;
+};
+
+static DWORD s_worker_slot = TlsAlloc();
+
+// CreateFiberEx lets a fiber reserve less address space for its stack than
+// the executable asks for, which CreateFiber can't.  It only exists from XP
+// on, so it's looked up.
+typedef LPVOID (WINAPI *create_fiber_ex_function)(SIZE_T commit_size, SIZE_T reserve_size, DWORD flags,
+	LPFIBER_START_ROUTINE start, LPVOID param);
+
+static create_fiber_ex_function find_create_fiber_ex()
+{
+	HMODULE kernel32 = GetModuleHandleA("kernel32.dll");
+	if (!kernel32)
+		return nullptr;
+
+	return (create_fiber_ex_function) GetProcAddress(kernel32, "CreateFiberEx");
+}
+
+static const create_fiber_ex_function s_create_fiber_ex = find_create_fiber_ex();
+
+static fiber_worker* current_worker()
+{
+	if (s_worker_slot == TLS_OUT_OF_INDEXES)
+		return nullptr;
+
+	return (fiber_worker*) TlsGetValue(s_worker_slot);
+}
+
+static detail::fiber_context* current_fiber()
+{
+	fiber_worker* worker = current_worker();
+	return worker ? worker->m_current : nullptr;
+}
+
+static fiber_ready_queue* shared_queue(detail::fiber_scheduler_state* sched)
+{
+	return &sched->m_queues[sched->m_worker_count];
+}
+
+static void push_ready(fiber_ready_queue* queue, detail::fiber_context* ctx)
+{
+	ctx->m_next_ready = nullptr;
+
+	lock_guard<fair_mutex> lg(queue->m_mutex);
+	if (queue->m_tail)
+		queue->m_tail->m_next_ready = ctx;
+	else
+		queue->m_head = ctx;
+	queue->m_tail = ctx;
+}
+
+static detail::fiber_context* pop_ready(fiber_ready_queue* queue)
+{
+	lock_guard<fair_mutex> lg(queue->m_mutex);
+	detail::fiber_context* ctx = queue->m_head;
+	if (ctx) {
+		queue->m_head = ctx->m_next_ready;
+		if (!queue->m_head)
+			queue->m_tail = nullptr;
+	}
+	return ctx;
+}
+
+// The worker may be in the middle of going to sleep.  Either it sees the new
+// signal before parking, or it's parked and gets woken here.
+static void wake_worker(fiber_ready_queue* queue) noexcept
+{
+	queue->m_signal.fetch_add(1);
+	if (queue->m_sleeping.exchange(false))
+		parking_lot::unpark_all(&queue->m_signal);
+}
+
+// Wakes one sleeping worker to look at the shared queue.  If none is
+// asleep, they're all going to look at it before they sleep.
+static void wake_any_worker(detail::fiber_scheduler_state* sched) noexcept
+{
+	sched->m_shared_signal.fetch_add(1);
+
+	unsigned count = sched->m_worker_count;
+	unsigned start = sched->m_wake_start.fetch_add(1, std::memory_order_relaxed);
+	for (unsigned i = 0; i < count; i++) {
+		fiber_ready_queue* queue = &sched->m_queues[(start + i) % count];
+		if (queue->m_sleeping.load() && queue->m_sleeping.exchange(false)) {
+			queue->m_signal.fetch_add(1);
+			parking_lot::unpark_all(&queue->m_signal);
+			return;
+		}
+	}
+}
+
+// A fiber that has run before goes back to its own worker.  One that hasn't
+// goes on the shared queue, for whichever worker is free first.  `wake` can
+// be false when the caller is the worker that's about to look anyway.
+static void make_ready(detail::fiber_context* ctx, bool wake = true) noexcept
+{
+	detail::fiber_scheduler_state* sched = ctx->m_scheduler;
+	fiber_ready_queue* home = ctx->m_home;
+	push_ready(home ? home : shared_queue(sched), ctx);
+
+	if (!wake)
+		return;
+
+	if (home)
+		wake_worker(home);
+	else
+		wake_any_worker(sched);
+}
+
+static detail::fiber_context* next_ready(fiber_worker& worker)
+{
+	fiber_ready_queue* shared = shared_queue(worker.m_scheduler);
+	detail::fiber_context* ctx;
+
+	if (++worker.m_picks % shared_check_interval == 0) {
+		ctx = pop_ready(shared);
+		if (ctx)
+			return ctx;
+	}
+
+	ctx = pop_ready(worker.m_queue);
+	return ctx ? ctx : pop_ready(shared);
+}
+
+// Returns null once the scheduler is stopping.
+static detail::fiber_context* take_ready(fiber_worker& worker)
+{
+	detail::fiber_scheduler_state* sched = worker.m_scheduler;
+	fiber_ready_queue* own = worker.m_queue;
+
+	for (;;) {
+		detail::fiber_context* ctx = next_ready(worker);
+		if (ctx)
+			return ctx;
+
+		if (sched->m_stopping.load())
+			return nullptr;
+
+		// Announce ourselves before the last look, so that make_ready either
+		// sees us sleeping or we see its fiber.
+		uint32_t seen = own->m_signal.load();
+		uint32_t seen_shared = sched->m_shared_signal.load();
+		own->m_sleeping.exchange(true);
+
+		ctx = next_ready(worker);
+		if (ctx || sched->m_stopping.load()) {
+			own->m_sleeping.store(false);
+			return ctx;
+		}
+
+		parking_lot::park(&own->m_signal, [own, sched, seen, seen_shared]() {
+			return own->m_signal.load() == seen && sched->m_shared_signal.load() == seen_shared;
+		});
+		own->m_sleeping.store(false);
+	}
+}
+
+// Switches from the current fiber back to its worker, which calls
+// after_switch(arg) once it is there.
+static void suspend(void (*after_switch)(void*), void* arg)
+{
+	fiber_worker* worker = current_worker();
+	worker->m_after_switch = after_switch;
+	worker->m_after_switch_arg = arg;
+	SwitchToFiber(worker->m_main);
+}
+
+static void release_context(detail::fiber_context* ctx) noexcept
+{
+	if (ctx->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		delete ctx;
+}
+
+static void unlock_guard(void* arg)
+{
+	static_cast<fair_mutex*>(arg)->unlock();
+}
+
+static void requeue_fiber(void* arg)
+{
+	make_ready(static_cast<detail::fiber_context*>(arg), false);
+}
+
+// A fiber can't delete itself, so its worker does it.
+static void delete_fiber(void* arg)
+{
+	detail::fiber_context* ctx = static_cast<detail::fiber_context*>(arg);
+	detail::fiber_scheduler_state* sched = ctx->m_scheduler;
+
+	DeleteFiber(ctx->m_handle);
+	ctx->m_handle = nullptr;
+	release_context(ctx);
+
+	// The scheduler may be gone as soon as this hits zero.  unpark_all only
+	// uses the address, so that's fine.
+	if (sched->m_live.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		parking_lot::unpark_all(&sched->m_live);
+}
+
+static void WINAPI fiber_main(LPVOID param)
+{
+	detail::fiber_context* ctx = (detail::fiber_context*) param;
+
+	detail::fiber_function* fn = ctx->m_function;
+	ctx->m_function = nullptr;
+	fn->run();
+
+	detail::fiber_wait_list joiners;
+	{
+		lock_guard<fair_mutex> lg(ctx->m_join_mutex);
+		ctx->m_done = true;
+		joiners = ctx->m_joiners;
+		ctx->m_joiners = detail::fiber_wait_list();
+	}
+
+	while (detail::fiber_waiter* waiter = joiners.pop())
+		detail::fiber_wake(*waiter);
+
+	suspend(&delete_fiber, ctx);
+
+	// Never resumed.
+	terminateIprogsThreads();
+}
+
+static void worker_main(detail::fiber_scheduler_state* sched, fiber_ready_queue* queue)
+{
+	fiber_worker worker;
+	worker.m_main = ConvertThreadToFiber(nullptr);
+	if (!worker.m_main)
+		terminateIprogsThreads();
+
+	worker.m_scheduler = sched;
+	worker.m_queue = queue;
+	TlsSetValue(s_worker_slot, &worker);
+
+	while (detail::fiber_context* ctx = take_ready(worker)) {
+		// Pin it here, so that whatever it has tied to this thread stays
+		// valid across switches.
+		if (!ctx->m_home)
+			ctx->m_home = queue;
+
+		worker.m_current = ctx;
+		SwitchToFiber(ctx->m_handle);
+		worker.m_current = nullptr;
+
+		void (*after_switch)(void*) = worker.m_after_switch;
+		worker.m_after_switch = nullptr;
+		if (after_switch)
+			after_switch(worker.m_after_switch_arg);
+	}
+
+	TlsSetValue(s_worker_slot, nullptr);
+	ConvertFiberToThread();
+}
+
+static void stop_workers(detail::fiber_scheduler_state* sched)
+{
+	sched->m_stopping.store(true);
+	for (unsigned i = 0; i < sched->m_worker_count; i++) {
+		fiber_ready_queue* queue = &sched->m_queues[i];
+		queue->m_signal.fetch_add(1);
+		queue->m_sleeping.store(false);
+		parking_lot::unpark_all(&queue->m_signal);
+	}
+
+	for (size_t i = 0; i < sched->m_workers.size(); i++)
+		sched->m_workers[i].join();
+}
+
+fiber_scheduler::fiber_scheduler(unsigned workers, size_t stack_size)
+{
+	if (s_worker_slot == TLS_OUT_OF_INDEXES)
+		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+
+	if (workers == 0)
+		workers = thread::hardware_concurrency();
+	if (workers == 0)
+		workers = 1;
+
+	m_state = new detail::fiber_scheduler_state;
+	m_state->m_stack_size = stack_size;
+
+	try
+	{
+		m_state->m_queues = new fiber_ready_queue[workers + 1];
+		m_state->m_worker_count = workers;
+
+		m_state->m_workers.reserve(workers);
+		for (unsigned i = 0; i < workers; i++)
+			m_state->m_workers.push_back(thread(&worker_main, m_state, &m_state->m_queues[i]));
+	}
+	catch (...)
+	{
+		stop_workers(m_state);
+		delete m_state;
+		throw;
+	}
+}
+
+fiber_scheduler::~fiber_scheduler()
+{
+	detail::fiber_scheduler_state* sched = m_state;
+	while (sched->m_live.load(std::memory_order_acquire) != 0) {
+		parking_lot::park(&sched->m_live, [sched]() {
+			return sched->m_live.load(std::memory_order_acquire) != 0;
+		});
+	}
+
+	stop_workers(sched);
+	delete sched;
+}
+
+unsigned fiber_scheduler::worker_count() const noexcept
+{
+	return (unsigned) m_state->m_workers.size();
+}
+
+detail::fiber_context* detail::fiber_spawn(fiber_scheduler_state* sched, fiber_function* fn)
+{
+	fiber_context* ctx = nullptr;
+	try
+	{
+		ctx = new fiber_context;
+	}
+	catch (...)
+	{
+		fn->discard();
+		throw;
+	}
+
+	ctx->m_scheduler = sched;
+	ctx->m_function = fn;
+	if (s_create_fiber_ex) {
+		size_t reserve = sched->m_stack_size;
+		if (!reserve)
+			reserve = fiber_scheduler::default_stack_size;
+		ctx->m_handle = s_create_fiber_ex(0, reserve, 0, &fiber_main, ctx);
+	}
+	else {
+		ctx->m_handle = CreateFiber(sched->m_stack_size, &fiber_main, ctx);
+	}
+	if (!ctx->m_handle) {
+		fn->discard();
+		delete ctx;
+		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+	}
+
+	sched->m_live.fetch_add(1, std::memory_order_relaxed);
+	make_ready(ctx);
+	return ctx;
+}
+
+void detail::fiber_join(fiber_context* ctx)
+{
+	if (current_fiber() == ctx)
+		throw std::system_error(std::make_error_code(std::errc::resource_deadlock_would_occur));
+
+	fiber_waiter waiter;
+	fiber_prepare_wait(waiter);
+
+	ctx->m_join_mutex.lock();
+	if (ctx->m_done) {
+		ctx->m_join_mutex.unlock();
+		return;
+	}
+
+	ctx->m_joiners.push(&waiter);
+	fiber_wait(waiter, ctx->m_join_mutex);
+}
+
+void detail::fiber_release(fiber_context* ctx) noexcept
+{
+	release_context(ctx);
+}
+
+void detail::fiber_prepare_wait(fiber_waiter& waiter) noexcept
+{
+	waiter.m_fiber = current_fiber();
+	waiter.m_woken.store(0, std::memory_order_relaxed);
+}
+
+void detail::fiber_wait(fiber_waiter& waiter, fair_mutex& guard)
+{
+	if (waiter.m_fiber) {
+		suspend(&unlock_guard, &guard);
+		return;
+	}
+
+	guard.unlock();
+	while (waiter.m_woken.load(std::memory_order_acquire) == 0) {
+		parking_lot::park(&waiter.m_woken, [&waiter]() {
+			return waiter.m_woken.load(std::memory_order_acquire) == 0;
+		});
+	}
+}
+
+void detail::fiber_wake(fiber_waiter& waiter) noexcept
+{
+	fiber_context* ctx = waiter.m_fiber;
+	if (ctx) {
+		make_ready(ctx);
+		return;
+	}
+
+	// The waiter may be gone as soon as this is stored.  unpark_all only
+	// uses the address, so that's fine.
+	waiter.m_woken.store(1, std::memory_order_release);
+	parking_lot::unpark_all(&waiter.m_woken);
+}
+
+void this_fiber::yield()
+{
+	detail::fiber_context* ctx = current_fiber();
+	if (!ctx) {
+		this_thread::yield();
+		return;
+	}
+
+	suspend(&requeue_fiber, ctx);
+}
+
+bool this_fiber::is_fiber() noexcept
+{
+	return current_fiber() != nullptr;
+}
+
+} // namespace iprog
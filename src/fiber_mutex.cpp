@@ -0,0 +1,90 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <iprog/fiber_mutex.hpp>
+
+namespace iprog {
+
+void fiber_mutex::lock()
+{
+	m_guard.lock();
+	if (!m_locked) {
+		m_locked = true;
+		m_guard.unlock();
+		return;
+	}
+
+	// Whoever unlocks hands the mutex over to us without ever unlocking it,
+	// so it's ours once we're woken.
+	detail::fiber_waiter waiter;
+	detail::fiber_prepare_wait(waiter);
+	m_waiters.push(&waiter);
+	detail::fiber_wait(waiter, m_guard);
+}
+
+bool fiber_mutex::try_lock() noexcept
+{
+	if (!m_guard.try_lock())
+		return false;
+
+	bool acquired = !m_locked;
+	m_locked = true;
+	m_guard.unlock();
+	return acquired;
+}
+
+void fiber_mutex::unlock()
+{
+	m_guard.lock();
+	detail::fiber_waiter* waiter = m_waiters.pop();
+	if (!waiter)
+		m_locked = false;
+	m_guard.unlock();
+
+	if (waiter)
+		detail::fiber_wake(*waiter);
+}
+
+void fiber_condition_variable::wait(unique_lock<fiber_mutex>& lock)
+{
+	if (!lock.owns_lock())
+		throw std::system_error(std::make_error_code(std::errc::operation_not_permitted));
+
+	detail::fiber_waiter waiter;
+	detail::fiber_prepare_wait(waiter);
+
+	// Get on the list before letting go of the mutex, so a notify made under
+	// it right after can't be missed.
+	m_guard.lock();
+	m_waiters.push(&waiter);
+	lock.unlock();
+	detail::fiber_wait(waiter, m_guard);
+
+	lock.lock();
+}
+
+void fiber_condition_variable::notify_one() noexcept
+{
+	m_guard.lock();
+	detail::fiber_waiter* waiter = m_waiters.pop();
+	m_guard.unlock();
+
+	if (waiter)
+		detail::fiber_wake(*waiter);
+}
+
+void fiber_condition_variable::notify_all() noexcept
+{
+	m_guard.lock();
+	detail::fiber_wait_list waiters = m_waiters;
+	m_waiters = detail::fiber_wait_list();
+	m_guard.unlock();
+
+	while (detail::fiber_waiter* waiter = waiters.pop())
+		detail::fiber_wake(*waiter);
+}
+
+} // namespace iprog
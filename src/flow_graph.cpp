@@ -0,0 +1,157 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <iprog/flow_graph.hpp>
+#include <iprog/ticks.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+namespace iprog {
+
+void detail::flow_node_base::input_finished()
+{
+	if (m_open_inputs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		m_close(this);
+}
+
+flow_stats detail::flow_node_base::stats()
+{
+	flow_stats stats;
+	stats.processed = (uint64_t) m_processed.value();
+	stats.queue_depth = m_depth(this, &stats.max_queue_depth);
+	stats.items_per_second = 0;
+
+	if (m_started_ticks != 0) {
+		int64_t end = m_finished_ticks.load(std::memory_order_acquire);
+		if (end == 0)
+			end = detail::now_ticks();
+
+		if (end > m_started_ticks)
+			stats.items_per_second = double(stats.processed) * double(detail::tick_frequency()) / double(end - m_started_ticks);
+	}
+
+	return stats;
+}
+
+void detail::flow_worker_main(flow_node_base* node)
+{
+	try
+	{
+		node->m_run(node);
+	}
+	catch (...)
+	{
+		node->m_graph->fail(std::current_exception());
+	}
+
+	if (node->m_running.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	node->m_finished_ticks.store(detail::now_ticks(), std::memory_order_release);
+	if (node->m_successor)
+		node->m_successor->input_finished();
+}
+
+flow_graph::~flow_graph()
+{
+	if (m_started) {
+		cancel();
+		join_all();
+	}
+
+	for (size_t i = 0; i < m_nodes.size(); i++)
+		m_nodes[i]->m_destroy(m_nodes[i]);
+}
+
+void flow_graph::add(detail::flow_node_base* node)
+{
+	try
+	{
+		m_nodes.push_back(node);
+	}
+	catch (...)
+	{
+		node->m_destroy(node);
+		throw;
+	}
+}
+
+void flow_graph::start()
+{
+	if (m_started)
+		throw std::system_error(std::make_error_code(std::errc::operation_not_permitted));
+	m_started = true;
+
+	int64_t start = detail::now_ticks();
+	for (size_t i = 0; i < m_nodes.size(); i++) {
+		m_nodes[i]->m_started_ticks = start;
+		m_nodes[i]->m_running.store(m_nodes[i]->m_options.concurrency, std::memory_order_relaxed);
+	}
+
+	for (size_t i = 0; i < m_nodes.size(); i++) {
+		detail::flow_node_base* node = m_nodes[i];
+		unsigned count = node->m_options.concurrency;
+		for (unsigned j = 0; j < count; j++) {
+			try
+			{
+				node->m_workers.push_back(thread(&detail::flow_worker_main, node));
+			}
+			catch (...)
+			{
+				// The ones that never started won't finish the node.  Whoever
+				// is running stops on the cancel.
+				for (unsigned k = j; k < count; k++)
+					node->m_running.fetch_sub(1, std::memory_order_relaxed);
+				for (size_t k = i + 1; k < m_nodes.size(); k++)
+					m_nodes[k]->m_running.store(0, std::memory_order_relaxed);
+
+				cancel();
+				join_all();
+				throw;
+			}
+		}
+	}
+}
+
+void flow_graph::join_all() noexcept
+{
+	for (size_t i = 0; i < m_nodes.size(); i++) {
+		std::vector<thread>& workers = m_nodes[i]->m_workers;
+		for (size_t j = 0; j < workers.size(); j++) {
+			if (workers[j].joinable())
+				workers[j].join();
+		}
+	}
+}
+
+void flow_graph::wait()
+{
+	if (!m_started)
+		throw std::system_error(std::make_error_code(std::errc::operation_not_permitted));
+
+	join_all();
+
+	if (m_error)
+		std::rethrow_exception(m_error);
+}
+
+void flow_graph::cancel() noexcept
+{
+	m_cancelled.store(true);
+	for (size_t i = 0; i < m_nodes.size(); i++)
+		m_nodes[i]->m_abort(m_nodes[i]);
+}
+
+void flow_graph::fail(std::exception_ptr error) noexcept
+{
+	if (!m_failed.exchange(true))
+		m_error = error;
+
+	cancel();
+}
+
+} // namespace iprog
@@ -0,0 +1,561 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <map>
+
+#include <iprog/interprocess_mutex.hpp>
+#include <iprog/interprocess_condition_variable.hpp>
+#include <iprog/fair_mutex.hpp>
+#include <iprog/lock_guard.hpp>
+#include <iprog/ticks.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+namespace iprog {
+
+// Way more than there will ever be waiters, so releasing never fails for
+// lack of room.
+static const LONG semaphore_max = 0x7FFFFFFF;
+
+static fair_mutex s_semaphore_mutex;
+static std::map<uint64_t, HANDLE> s_semaphores;
+
+static std::atomic<uint32_t> s_next_id{ 0 };
+
+uint64_t detail::interprocess_make_id() noexcept
+{
+	// The process ID keeps it apart from other processes' IDs, and the
+	// counter from ours.  The counter starts somewhere random-ish, in case
+	// the process ID is reused while an old object is still around.
+	static const uint32_t s_counter_base = (uint32_t) detail::now_ticks();
+
+	uint32_t counter = s_counter_base + s_next_id.fetch_add(1, std::memory_order_relaxed);
+	return ((uint64_t) GetCurrentProcessId() << 32) | counter;
+}
+
+void* detail::interprocess_semaphore(uint64_t id)
+{
+	lock_guard<fair_mutex> lg(s_semaphore_mutex);
+
+	std::map<uint64_t, HANDLE>::iterator it = s_semaphores.find(id);
+	if (it != s_semaphores.end())
+		return it->second;
+
+	char name[32] = "iprog_ipc_";
+	static const char digits[] = "0123456789abcdef";
+	for (int i = 0; i < 16; i++)
+		name[10 + i] = digits[(id >> (60 - i * 4)) & 0xF];
+	name[26] = 0;
+
+	// Opens it instead, if another process got there first.
+	HANDLE sem = CreateSemaphoreA(NULL, 0, semaphore_max, name);
+	if (!sem)
+		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+
+	try
+	{
+		s_semaphores[id] = sem;
+	}
+	catch (...)
+	{
+		CloseHandle(sem);
+		throw;
+	}
+
+	return sem;
+}
+
+void detail::interprocess_forget(uint64_t id) noexcept
+{
+	lock_guard<fair_mutex> lg(s_semaphore_mutex);
+
+	std::map<uint64_t, HANDLE>::iterator it = s_semaphores.find(id);
+	if (it == s_semaphores.end())
+		return;
+
+	CloseHandle(it->second);
+	s_semaphores.erase(it);
+}
+
+static uint32_t current_process_id()
+{
+	static const uint32_t s_pid = (uint32_t) GetCurrentProcessId();
+	return s_pid;
+}
+
+// A process that has exited, or was never there.  Being denied access means
+// it's there, just not ours to look at.
+static bool process_alive(uint32_t pid)
+{
+	if (pid == current_process_id())
+		return true;
+
+	HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, (DWORD) pid);
+	if (!process)
+		return GetLastError() == ERROR_ACCESS_DENIED;
+
+	bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+	CloseHandle(process);
+	return alive;
+}
+
+interprocess_mutex::interprocess_mutex() noexcept :
+	m_state(unlocked), m_owner_pid(0), m_owner_tid(0), m_flags(0), m_waiters(0),
+	m_id(detail::interprocess_make_id())
+{
+}
+
+interprocess_mutex::~interprocess_mutex() noexcept
+{
+	detail::interprocess_forget(m_id);
+}
+
+void interprocess_mutex::acquired() noexcept
+{
+	m_owner_pid.store(current_process_id(), std::memory_order_relaxed);
+	m_owner_tid.store((uint32_t) GetCurrentThreadId(), std::memory_order_relaxed);
+}
+
+void interprocess_mutex::check_recoverable()
+{
+	if (m_flags.load(std::memory_order_acquire) & not_recoverable_bit)
+		throw std::system_error(std::make_error_code(std::errc::state_not_recoverable));
+}
+
+void interprocess_mutex::lock()
+{
+	check_recoverable();
+
+	uint32_t expected = unlocked;
+	if (m_state.compare_exchange_strong(expected, locked, std::memory_order_acquire, std::memory_order_relaxed)) {
+		acquired();
+		return;
+	}
+
+	lock_slow();
+}
+
+// If the owner died between taking the lock and recording itself, nobody can
+// tell, and the mutex stays locked.  That window is a handful of
+// instructions long.
+bool interprocess_mutex::claim_if_owner_dead()
+{
+	uint32_t pid = m_owner_pid.load(std::memory_order_relaxed);
+	if (pid == 0 || process_alive(pid))
+		return false;
+
+	// Only one of the waiters gets to take over.
+	if (!m_owner_pid.compare_exchange_strong(pid, current_process_id(), std::memory_order_acquire, std::memory_order_relaxed))
+		return false;
+
+	m_owner_tid.store((uint32_t) GetCurrentThreadId(), std::memory_order_relaxed);
+
+	// Others may be waiting, so have our unlock wake one.
+	m_state.store(locked_contended, std::memory_order_relaxed);
+	m_flags.fetch_or(inconsistent_bit, std::memory_order_release);
+	return true;
+}
+
+void interprocess_mutex::lock_slow()
+{
+	HANDLE sem = (HANDLE) detail::interprocess_semaphore(m_id);
+
+	if (m_owner_pid.load(std::memory_order_relaxed) == current_process_id() &&
+		m_owner_tid.load(std::memory_order_relaxed) == (uint32_t) GetCurrentThreadId())
+		throw std::system_error(std::make_error_code(std::errc::resource_deadlock_would_occur));
+
+	for (;;) {
+		// Counted before marking it contended, so that an unlock which sees
+		// the mark also sees us.  Both are sequentially consistent, like the
+		// exchange and load in unlock() they pair with.
+		m_waiters.fetch_add(1);
+
+		// Marks it contended whether or not we get it, since we can't tell
+		// whether anyone else is waiting.
+		if (m_state.exchange(locked_contended) == unlocked) {
+			m_waiters.fetch_sub(1, std::memory_order_relaxed);
+			acquired();
+			return;
+		}
+
+		DWORD ret = WaitForSingleObject(sem, owner_check_interval_ms);
+		m_waiters.fetch_sub(1, std::memory_order_relaxed);
+
+		if (ret == WAIT_FAILED)
+			terminateIprogsThreads();
+
+		check_recoverable();
+
+		// Ours now, but owner_died() will say so.
+		if (ret == WAIT_TIMEOUT && claim_if_owner_dead())
+			return;
+	}
+}
+
+bool interprocess_mutex::try_lock()
+{
+	check_recoverable();
+
+	uint32_t expected = unlocked;
+	if (m_state.compare_exchange_strong(expected, locked, std::memory_order_acquire, std::memory_order_relaxed)) {
+		acquired();
+		return true;
+	}
+
+	return claim_if_owner_dead();
+}
+
+void interprocess_mutex::unlock()
+{
+	// Unlocking without repairing gives up on the data for good.
+	bool give_up = false;
+	uint32_t flags = m_flags.load(std::memory_order_relaxed);
+	if (flags & inconsistent_bit) {
+		m_flags.store(not_recoverable_bit, std::memory_order_release);
+		give_up = true;
+	}
+
+	m_owner_tid.store(0, std::memory_order_relaxed);
+	m_owner_pid.store(0, std::memory_order_relaxed);
+
+	if (m_state.exchange(unlocked) != locked_contended && !give_up)
+		return;
+
+	// Whoever takes the mutex next marks it contended, in case anyone else
+	// is waiting, so it often is when nobody is.  Waking nobody would leave
+	// a count behind for a spurious wakeup later.
+	LONG count = (LONG) m_waiters.load();
+	if (count == 0)
+		return;
+
+	// Everyone waiting has to find out that it's over.
+	if (!give_up)
+		count = 1;
+
+	ReleaseSemaphore((HANDLE) detail::interprocess_semaphore(m_id), count, NULL);
+}
+
+void interprocess_mutex::consistent()
+{
+	if (!(m_flags.load(std::memory_order_relaxed) & inconsistent_bit) ||
+		m_owner_pid.load(std::memory_order_relaxed) != current_process_id() ||
+		m_owner_tid.load(std::memory_order_relaxed) != (uint32_t) GetCurrentThreadId())
+		throw std::system_error(std::make_error_code(std::errc::invalid_argument));
+
+	m_flags.fetch_and(~inconsistent_bit, std::memory_order_release);
+}
+
+interprocess_condition_variable::interprocess_condition_variable() noexcept :
+	m_state(0), m_id(detail::interprocess_make_id())
+{
+	for (size_t i = 0; i < max_waiting_processes; i++) {
+		m_processes[i].m_pid.store(0, std::memory_order_relaxed);
+		m_processes[i].m_waiters.store(0, std::memory_order_relaxed);
+	}
+}
+
+interprocess_condition_variable::~interprocess_condition_variable() noexcept
+{
+	detail::interprocess_forget(m_id);
+}
+
+size_t interprocess_condition_variable::add_waiter(uint64_t& generation)
+{
+	uint32_t pid = current_process_id();
+
+	// Find our slot, or claim a free one.  Slots are only given up by
+	// expire_dead_waiters(), once their process is gone.
+	size_t slot = max_waiting_processes;
+	for (int attempt = 0; slot == max_waiting_processes && attempt < 2; attempt++) {
+		for (size_t i = 0; i < max_waiting_processes; i++) {
+			if (m_processes[i].m_pid.load(std::memory_order_acquire) == pid) {
+				slot = i;
+				break;
+			}
+		}
+
+		for (size_t i = 0; slot == max_waiting_processes && i < max_waiting_processes; i++) {
+			uint32_t expected = 0;
+			if (m_processes[i].m_pid.compare_exchange_strong(expected, pid, std::memory_order_acq_rel))
+				slot = i;
+		}
+
+		if (slot == max_waiting_processes)
+			expire_dead_waiters();
+	}
+
+	if (slot == max_waiting_processes)
+		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+
+	uint64_t state = m_state.load(std::memory_order_acquire);
+	do {
+		if (new_waiters_of(state) + old_waiters_of(state) >= count_mask)
+			throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+	}
+	while (!m_state.compare_exchange_weak(state, state + one_new_waiter, std::memory_order_acq_rel, std::memory_order_acquire));
+
+	generation = generation_of(state);
+
+	// The slot keeps its waiters apart by generation in the same way, so
+	// that they can be taken off the right count if this process dies.
+	std::atomic<uint64_t>& waiters = m_processes[slot].m_waiters;
+	uint64_t current = waiters.load(std::memory_order_relaxed);
+	uint64_t next;
+	do {
+		uint64_t slot_generation = current & generation_mask;
+		uint64_t slot_new = (current / slot_one_new) & slot_count_mask;
+		uint64_t slot_old = current / slot_one_old;
+
+		if (slot_generation == generation || (slot_new == 0 && slot_old == 0)) {
+			// The newest, or the first.
+			slot_generation = generation;
+			slot_new++;
+		}
+		else if (((slot_generation - generation) & generation_mask) <= generation_mask / 2) {
+			// Another of our threads came in after a notify that we missed.
+			slot_old++;
+		}
+		else {
+			// A notify since our last waiter came in made them all old.
+			slot_old += slot_new;
+			slot_new = 1;
+			slot_generation = generation;
+		}
+
+		next = slot_generation + slot_new * slot_one_new + slot_old * slot_one_old;
+	}
+	while (!waiters.compare_exchange_weak(current, next, std::memory_order_relaxed));
+
+	return slot;
+}
+
+void interprocess_condition_variable::remove_waiter(size_t slot, uint64_t generation) noexcept
+{
+	std::atomic<uint64_t>& waiters = m_processes[slot].m_waiters;
+	uint64_t current = waiters.load(std::memory_order_relaxed);
+	uint64_t next;
+	do {
+		uint64_t slot_generation = current & generation_mask;
+		uint64_t slot_new = (current / slot_one_new) & slot_count_mask;
+		uint64_t slot_old = current / slot_one_old;
+
+		if (slot_generation == generation && slot_new)
+			slot_new--;
+		else if (slot_old)
+			slot_old--;
+
+		next = slot_generation + slot_new * slot_one_new + slot_old * slot_one_old;
+	}
+	while (!waiters.compare_exchange_weak(current, next, std::memory_order_relaxed));
+}
+
+interprocess_condition_variable::wakeup_kind interprocess_condition_variable::take_wakeup(uint64_t generation) noexcept
+{
+	uint64_t state = m_state.load(std::memory_order_acquire);
+	for (;;) {
+		// More counts were given out than there are wakeups, so this one's
+		// waiter was written off.
+		if (wakeups_of(state) == 0)
+			return wakeup_stale;
+
+		if (generation_of(state) == generation)
+			return wakeup_not_ours;
+
+		if (m_state.compare_exchange_weak(state, state - one_wakeup - one_old_waiter, std::memory_order_acq_rel, std::memory_order_acquire))
+			return wakeup_taken;
+	}
+}
+
+bool interprocess_condition_variable::take_wakeup_or_leave(uint64_t generation) noexcept
+{
+	uint64_t state = m_state.load(std::memory_order_acquire);
+	for (;;) {
+		bool old = generation_of(state) != generation;
+		if (old && wakeups_of(state) != 0) {
+			if (m_state.compare_exchange_weak(state, state - one_wakeup - one_old_waiter, std::memory_order_acq_rel, std::memory_order_acquire))
+				return true;
+			continue;
+		}
+
+		// Writing off a dead process's waiters can take from the wrong
+		// count, if it died halfway through waiting.  Never wrap either.
+		uint64_t one = old ? one_old_waiter : one_new_waiter;
+		if (old ? !old_waiters_of(state) : !new_waiters_of(state))
+			one = old ? one_new_waiter : one_old_waiter;
+		if (!(state & (count_mask * one)))
+			return false;
+
+		if (m_state.compare_exchange_weak(state, state - one, std::memory_order_acq_rel, std::memory_order_acquire))
+			return false;
+	}
+}
+
+void interprocess_condition_variable::expire_dead_waiters() noexcept
+{
+	uint32_t self = current_process_id();
+
+	for (size_t i = 0; i < max_waiting_processes; i++) {
+		waiting_process& process = m_processes[i];
+
+		uint32_t pid = process.m_pid.load(std::memory_order_acquire);
+		if (pid == 0 || pid == self || process_alive(pid))
+			continue;
+
+		// Only one of us gets to take its count off, and its slot is empty
+		// before anyone else can claim it.
+		uint64_t waiters = process.m_waiters.load(std::memory_order_acquire);
+		if (waiters && !process.m_waiters.compare_exchange_strong(waiters, 0, std::memory_order_acq_rel))
+			continue;
+
+		process.m_pid.compare_exchange_strong(pid, 0, std::memory_order_acq_rel);
+		if (!waiters)
+			continue;
+
+		uint64_t slot_generation = waiters & generation_mask;
+		uint64_t slot_new = (waiters / slot_one_new) & slot_count_mask;
+		uint64_t slot_old = waiters / slot_one_old;
+
+		uint64_t state = m_state.load(std::memory_order_acquire);
+		uint64_t next;
+		do {
+			// Its newest waiters only still count as new if there has been
+			// no notify since.
+			uint64_t gone_new = slot_generation == generation_of(state) ? slot_new : 0;
+			uint64_t gone_old = slot_new + slot_old - gone_new;
+			if (gone_new > new_waiters_of(state))
+				gone_new = new_waiters_of(state);
+			if (gone_old > old_waiters_of(state))
+				gone_old = old_waiters_of(state);
+
+			// Wakeups given to them are nobody's now.
+			uint64_t old_left = old_waiters_of(state) - gone_old;
+			uint64_t gone_wakeups = wakeups_of(state) > old_left ? wakeups_of(state) - old_left : 0;
+
+			next = state - gone_new * one_new_waiter - gone_old * one_old_waiter - gone_wakeups * one_wakeup;
+		}
+		while (!m_state.compare_exchange_weak(state, next, std::memory_order_acq_rel, std::memory_order_acquire));
+	}
+}
+
+cv_status interprocess_condition_variable::wait_impl(unique_lock<interprocess_mutex>& lock, int64_t ns)
+{
+	if (!lock.owns_lock())
+		throw std::system_error(std::make_error_code(std::errc::operation_not_permitted));
+
+	// Before unlocking, so that failing to get it leaves the caller as it
+	// was.
+	HANDLE sem = (HANDLE) detail::interprocess_semaphore(m_id);
+
+	int64_t deadline = ns < 0 ? 0 : detail::now_ticks() + detail::ns_to_ticks(ns);
+	int64_t ticks_per_ms = detail::ticks_per_ms();
+
+	// Under the mutex, so a notify made under it after we unlock is sure to
+	// count us, and to move on from the generation we saw.
+	uint64_t generation;
+	size_t slot = add_waiter(generation);
+	lock.unlock();
+
+	cv_status status = cv_status::no_timeout;
+	for (;;) {
+		DWORD wait = INFINITE;
+		if (ns >= 0) {
+			int64_t left = deadline - detail::now_ticks();
+			int64_t ms = left <= 0 ? 0 : (left + ticks_per_ms - 1) / ticks_per_ms;
+			wait = ms < (int64_t) INFINITE ? (DWORD) ms : INFINITE - 1;
+		}
+
+		DWORD ret = wait == 0 ? WAIT_TIMEOUT : WaitForSingleObject(sem, wait);
+		if (ret == WAIT_FAILED)
+			terminateIprogsThreads();
+
+		if (ret == WAIT_OBJECT_0) {
+			wakeup_kind kind = take_wakeup(generation);
+
+			// Meant for someone who was waiting before us.  If they died,
+			// it is nobody's.
+			if (kind == wakeup_not_ours) {
+				expire_dead_waiters();
+				kind = take_wakeup(generation);
+			}
+
+			if (kind == wakeup_taken)
+				break;
+
+			// Otherwise, someone alive is waiting for it.  They are either
+			// asleep on the semaphore, and get it ahead of us, or on their
+			// way to take it, so let them run.
+			if (kind == wakeup_not_ours) {
+				ReleaseSemaphore(sem, 1, NULL);
+				Sleep(0);
+			}
+			continue;
+		}
+
+		// Timed out.  We may still have been notified in the meantime, in
+		// which case that wakeup is ours to take.  The count on the semaphore
+		// that came with it is left over, and dropped by whoever gets it.
+		if (take_wakeup_or_leave(generation))
+			break;
+
+		status = cv_status::timeout;
+		break;
+	}
+
+	remove_waiter(slot, generation);
+	lock.lock();
+	return status;
+}
+
+void interprocess_condition_variable::notify_one()
+{
+	uint64_t state = m_state.load(std::memory_order_acquire);
+	if (new_waiters_of(state) + old_waiters_of(state) <= wakeups_of(state))
+		return;
+
+	// Before giving the wakeup out, so that failing to get it doesn't leave
+	// one nobody can take.
+	HANDLE sem = (HANDLE) detail::interprocess_semaphore(m_id);
+
+	// Everyone waiting now is from before this notify.  The generation may
+	// wrap around, off the top of the word.
+	uint64_t next;
+	do {
+		uint64_t waiting = new_waiters_of(state) + old_waiters_of(state);
+		if (waiting <= wakeups_of(state))
+			return;
+
+		next = state - new_waiters_of(state) * one_new_waiter + new_waiters_of(state) * one_old_waiter + one_wakeup + one_generation;
+	}
+	while (!m_state.compare_exchange_weak(state, next, std::memory_order_acq_rel, std::memory_order_acquire));
+
+	ReleaseSemaphore(sem, 1, NULL);
+}
+
+void interprocess_condition_variable::notify_all()
+{
+	uint64_t state = m_state.load(std::memory_order_acquire);
+	if (new_waiters_of(state) + old_waiters_of(state) <= wakeups_of(state))
+		return;
+
+	HANDLE sem = (HANDLE) detail::interprocess_semaphore(m_id);
+
+	uint64_t count;
+	uint64_t next;
+	do {
+		uint64_t waiting = new_waiters_of(state) + old_waiters_of(state);
+		if (waiting <= wakeups_of(state))
+			return;
+
+		count = waiting - wakeups_of(state);
+		next = state - new_waiters_of(state) * one_new_waiter + new_waiters_of(state) * one_old_waiter + count * one_wakeup + one_generation;
+	}
+	while (!m_state.compare_exchange_weak(state, next, std::memory_order_acq_rel, std::memory_order_acquire));
+
+	ReleaseSemaphore(sem, (LONG) count, NULL);
+}
+
+} // namespace iprog
@@ -0,0 +1,298 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <algorithm>
+
+#include <iprog/io_context.hpp>
+#include <iprog/lock_guard.hpp>
+#include <iprog/ticks.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+namespace iprog {
+
+// Completion keys.  Handles are registered with io_key, so their completions
+// carry it, and so do posted handlers.
+static const ULONG_PTR io_key = 0;
+static const ULONG_PTR fail_key = 1;
+static const ULONG_PTR wake_key = 2;
+
+static const int64_t no_deadline = INT64_MAX;
+
+io_context::io_context(unsigned concurrency_hint)
+{
+	static_assert(sizeof(((io_operation*) nullptr)->m_overlapped) >= sizeof(OVERLAPPED), "io_operation is too small for an OVERLAPPED");
+
+	m_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, (DWORD) concurrency_hint);
+	if (!m_port) {
+		if (GetLastError() == ERROR_CALL_NOT_IMPLEMENTED)
+			throw std::system_error(std::make_error_code(std::errc::function_not_supported));
+		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+	}
+}
+
+io_context::~io_context() noexcept
+{
+	// Free whatever is still queued, including completions nobody ran.
+	for (;;) {
+		DWORD bytes = 0;
+		ULONG_PTR key = 0;
+		LPOVERLAPPED ov = nullptr;
+		BOOL ok = GetQueuedCompletionStatus((HANDLE) m_port, &bytes, &key, &ov, 0);
+		if (ov) {
+			io_operation* op = reinterpret_cast<io_operation*>(ov);
+			op->m_complete(op, nullptr, 0);
+			continue;
+		}
+
+		// A wake packet.  Anything else means the queue is empty.
+		if (!ok)
+			break;
+	}
+
+	for (size_t i = 0; i < m_timers.size(); i++)
+		m_timers[i].m_op->m_complete(m_timers[i].m_op, nullptr, 0);
+
+	CloseHandle((HANDLE) m_port);
+}
+
+void io_context::register_handle(void* handle)
+{
+	if (!CreateIoCompletionPort((HANDLE) handle, (HANDLE) m_port, io_key, 0))
+		throw std::system_error(std::make_error_code(std::errc::invalid_argument));
+}
+
+void io_context::fail(io_operation* op, const std::error_code& ec)
+{
+	// The operation never started, so its OVERLAPPED is ours to carry the
+	// error in.
+	op->m_overlapped[0] = (uintptr_t) ec.value();
+	op->m_overlapped[1] = (uintptr_t) &ec.category();
+
+	if (!PostQueuedCompletionStatus((HANDLE) m_port, 0, fail_key, (LPOVERLAPPED) op->overlapped())) {
+		op->m_complete(op, nullptr, 0);
+		work_finished();
+		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+	}
+}
+
+void io_context::enqueue(io_operation* op)
+{
+	if (!PostQueuedCompletionStatus((HANDLE) m_port, 0, io_key, (LPOVERLAPPED) op->overlapped())) {
+		op->m_complete(op, nullptr, 0);
+		work_finished();
+		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+	}
+}
+
+void io_context::wake_one() noexcept
+{
+	PostQueuedCompletionStatus((HANDLE) m_port, 0, wake_key, NULL);
+}
+
+bool io_context::later_deadline(const timer_entry& a, const timer_entry& b) noexcept
+{
+	return a.m_deadline > b.m_deadline;
+}
+
+io_context::timer_id io_context::schedule(int64_t ns, io_operation* op)
+{
+	timer_entry entry;
+	entry.m_deadline = detail::now_ticks() + detail::ns_to_ticks(ns);
+	entry.m_op = op;
+
+	bool earliest;
+	{
+		lock_guard<fair_mutex> lg(m_timer_mutex);
+		entry.m_id = m_next_timer_id++;
+
+		try
+		{
+			m_timers.push_back(entry);
+		}
+		catch (...)
+		{
+			op->m_complete(op, nullptr, 0);
+			work_finished();
+			throw;
+		}
+
+		std::push_heap(m_timers.begin(), m_timers.end(), &later_deadline);
+		earliest = m_timers.front().m_id == entry.m_id;
+	}
+
+	// Threads already waiting would sleep past this one, so get one of them
+	// to look again.
+	if (earliest)
+		wake_one();
+
+	return entry.m_id;
+}
+
+bool io_context::cancel(timer_id id) noexcept
+{
+	io_operation* op = nullptr;
+	{
+		lock_guard<fair_mutex> lg(m_timer_mutex);
+		for (size_t i = 0; i < m_timers.size(); i++) {
+			if (m_timers[i].m_id != id)
+				continue;
+
+			op = m_timers[i].m_op;
+			m_timers[i] = m_timers.back();
+			m_timers.pop_back();
+			std::make_heap(m_timers.begin(), m_timers.end(), &later_deadline);
+			break;
+		}
+	}
+
+	if (!op)
+		return false;
+
+	op->m_complete(op, nullptr, 0);
+	work_finished();
+	return true;
+}
+
+int64_t io_context::next_deadline() noexcept
+{
+	lock_guard<fair_mutex> lg(m_timer_mutex);
+	return m_timers.empty() ? no_deadline : m_timers.front().m_deadline;
+}
+
+bool io_context::run_due_timer()
+{
+	timer_entry entry;
+	{
+		lock_guard<fair_mutex> lg(m_timer_mutex);
+		if (m_timers.empty() || m_timers.front().m_deadline > detail::now_ticks())
+			return false;
+
+		std::pop_heap(m_timers.begin(), m_timers.end(), &later_deadline);
+		entry = m_timers.back();
+		m_timers.pop_back();
+	}
+
+	struct finish_guard
+	{
+		io_context* m_ctx;
+		~finish_guard() { m_ctx->work_finished(); }
+	} guard = { this };
+
+	std::error_code ec;
+	entry.m_op->m_complete(entry.m_op, &ec, 0);
+	return true;
+}
+
+size_t io_context::do_run_one(uint32_t timeout)
+{
+	int64_t ticks_per_ms = detail::ticks_per_ms();
+
+	for (;;) {
+		if (stopped())
+			return 0;
+
+		if (m_outstanding.load(std::memory_order_acquire) == 0) {
+			stop();
+			return 0;
+		}
+
+		if (run_due_timer())
+			return 1;
+
+		// Don't sleep past the next timer.
+		DWORD wait = (DWORD) timeout;
+		bool timer_limited = false;
+		int64_t deadline = next_deadline();
+		if (deadline != no_deadline) {
+			int64_t ms = (deadline - detail::now_ticks() + ticks_per_ms - 1) / ticks_per_ms;
+			if (ms < 0)
+				ms = 0;
+			if (ms < (int64_t) wait) {
+				wait = (DWORD) ms;
+				timer_limited = true;
+			}
+		}
+
+		DWORD bytes = 0;
+		ULONG_PTR key = 0;
+		LPOVERLAPPED ov = nullptr;
+		BOOL ok = GetQueuedCompletionStatus((HANDLE) m_port, &bytes, &key, &ov, wait);
+		DWORD error = ok ? 0 : GetLastError();
+
+		if (!ov) {
+			if (ok) {
+				// A wake packet.  If we're stopping, pass it on, so every
+				// thread in run() gets one.
+				if (stopped()) {
+					wake_one();
+					return 0;
+				}
+				continue;
+			}
+
+			if (error == WAIT_TIMEOUT) {
+				if (timer_limited)
+					continue;
+				return 0;
+			}
+
+			// The port itself is broken.
+			terminateIprogsThreads();
+		}
+
+		io_operation* op = reinterpret_cast<io_operation*>(ov);
+		std::error_code ec;
+		if (key == fail_key)
+			ec = std::error_code((int) op->m_overlapped[0], *reinterpret_cast<const std::error_category*>(op->m_overlapped[1]));
+		else if (!ok)
+			ec = std::error_code((int) error, std::system_category());
+
+		struct finish_guard
+		{
+			io_context* m_ctx;
+			~finish_guard() { m_ctx->work_finished(); }
+		} guard = { this };
+
+		op->m_complete(op, &ec, (size_t) bytes);
+		return 1;
+	}
+}
+
+size_t io_context::run()
+{
+	size_t count = 0;
+	while (do_run_one(INFINITE))
+		count++;
+	return count;
+}
+
+size_t io_context::run_one()
+{
+	return do_run_one(INFINITE);
+}
+
+size_t io_context::poll()
+{
+	size_t count = 0;
+	while (do_run_one(0))
+		count++;
+	return count;
+}
+
+size_t io_context::poll_one()
+{
+	return do_run_one(0);
+}
+
+void io_context::stop() noexcept
+{
+	m_stopped.store(true, std::memory_order_release);
+	wake_one();
+}
+
+} // namespace iprog
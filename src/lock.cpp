@@ -0,0 +1,107 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <iprog/lock.hpp>
+#include <iprog/thread.hpp>
+
+namespace iprog {
+namespace detail {
+
+// Tries to lock every lockable except `first`, going round in order from the
+// one after it.  On failure, releases everything taken here, and returns the
+// index of the lockable that failed.  Returns -1 on success.
+static int try_lock_rest(lockable_ref* locks, size_t count, size_t first)
+{
+	size_t taken = 0;
+	try
+	{
+		for (taken = 0; taken < count - 1; taken++) {
+			size_t idx = (first + 1 + taken) % count;
+			if (!locks[idx].m_try_lock(locks[idx].m_object))
+				break;
+		}
+	}
+	catch (...)
+	{
+		for (size_t i = 0; i < taken; i++) {
+			size_t idx = (first + 1 + i) % count;
+			locks[idx].m_unlock(locks[idx].m_object);
+		}
+		throw;
+	}
+
+	if (taken == count - 1)
+		return -1;
+
+	for (size_t i = 0; i < taken; i++) {
+		size_t idx = (first + 1 + i) % count;
+		locks[idx].m_unlock(locks[idx].m_object);
+	}
+
+	return int((first + 1 + taken) % count);
+}
+
+void lock_all(lockable_ref* locks, size_t count)
+{
+	size_t first = 0;
+	for (;;) {
+		// Block on the one that failed last time, since that's probably the
+		// contended one.
+		locks[first].m_lock(locks[first].m_object);
+
+		int failed;
+		try
+		{
+			failed = try_lock_rest(locks, count, first);
+		}
+		catch (...)
+		{
+			locks[first].m_unlock(locks[first].m_object);
+			throw;
+		}
+
+		if (failed < 0)
+			return;
+
+		locks[first].m_unlock(locks[first].m_object);
+		first = size_t(failed);
+
+		// Give the owner a chance to release it before we come back around.
+		this_thread::yield();
+	}
+}
+
+int try_lock_all(lockable_ref* locks, size_t count)
+{
+	size_t taken = 0;
+	try
+	{
+		for (taken = 0; taken < count; taken++) {
+			if (!locks[taken].m_try_lock(locks[taken].m_object))
+				break;
+		}
+	}
+	catch (...)
+	{
+		unlock_all(locks, taken);
+		throw;
+	}
+
+	if (taken == count)
+		return -1;
+
+	unlock_all(locks, taken);
+	return int(taken);
+}
+
+void unlock_all(lockable_ref* locks, size_t count) noexcept
+{
+	for (size_t i = 0; i < count; i++)
+		locks[i].m_unlock(locks[i].m_object);
+}
+
+} // namespace detail
+} // namespace iprog
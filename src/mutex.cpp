@@ -6,49 +6,103 @@
 
 #include <iprog/thread.hpp>
 #include <iprog/mutex.hpp>
+#include <iprog/trace.hpp>
+#include <iprog/parking_lot.hpp>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
-#ifdef  USE_IPROGS_REIMPL
-#	include <ri/reimpl.hpp>
-#	define _TryEnterCriticalSection ri::TryEnterCriticalSection
-#else
-#	define _TryEnterCriticalSection TryEnterCriticalSection
-#endif
-
 namespace iprog {
 
+// How often to retry before parking, while nobody is parked yet.
+static const unsigned spin_limit = 40;
+
 recursive_mutex::recursive_mutex() noexcept
 {
-	LPCRITICAL_SECTION crit = new CRITICAL_SECTION;
-	InitializeCriticalSection(crit);
-	m_handle = crit;
 }
 
 recursive_mutex::~recursive_mutex() noexcept
 {
-	LPCRITICAL_SECTION crit = (LPCRITICAL_SECTION) m_handle;
-	DeleteCriticalSection(crit);
-	delete crit;
 }
 
 void recursive_mutex::lock()
 {
-	LPCRITICAL_SECTION crit = (LPCRITICAL_SECTION) m_handle;
-	EnterCriticalSection(crit);
+	uint32_t self = (uint32_t) GetCurrentThreadId();
+	if (m_owner.load(std::memory_order_relaxed) == self) {
+		if (m_recursion == UINT32_MAX)
+			throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+
+		m_recursion++;
+		return;
+	}
+
+	uint32_t state = unlocked;
+	if (!m_state.compare_exchange_strong(state, locked, std::memory_order_acquire, std::memory_order_relaxed)) {
+		// Only a lock that actually has to wait gets a wait event.
+		trace::record(trace_event::lock_wait, this);
+		lock_slow(state);
+	}
+
+	m_owner.store(self, std::memory_order_relaxed);
+	m_recursion = 1;
+	trace::record(trace_event::lock_acquired, this);
+}
+
+void recursive_mutex::lock_slow(uint32_t state)
+{
+	// Held, but nobody is parked yet.  The owner may be about to let go.
+	for (unsigned spins = 0; state == locked && spins < spin_limit; spins++) {
+		this_thread::yield();
+
+		state = unlocked;
+		if (m_state.compare_exchange_strong(state, locked, std::memory_order_acquire, std::memory_order_relaxed))
+			return;
+	}
+
+	// From here on the mutex is marked contended, so whoever unlocks it
+	// wakes one of us.  That may leave it marked after the last waiter is
+	// gone, which only costs one needless unpark.
+	if (state != locked_contended)
+		state = m_state.exchange(locked_contended, std::memory_order_acquire);
+
+	while (state != unlocked) {
+		parking_lot::park(&m_state, [this]() {
+			return m_state.load(std::memory_order_relaxed) == locked_contended;
+		});
+		state = m_state.exchange(locked_contended, std::memory_order_acquire);
+	}
 }
 
 bool recursive_mutex::try_lock()
 {
-	LPCRITICAL_SECTION crit = (LPCRITICAL_SECTION) m_handle;
-	return _TryEnterCriticalSection(crit) != FALSE;
+	uint32_t self = (uint32_t) GetCurrentThreadId();
+	if (m_owner.load(std::memory_order_relaxed) == self) {
+		if (m_recursion == UINT32_MAX)
+			return false;
+
+		m_recursion++;
+		return true;
+	}
+
+	uint32_t state = unlocked;
+	if (!m_state.compare_exchange_strong(state, locked, std::memory_order_acquire, std::memory_order_relaxed))
+		return false;
+
+	m_owner.store(self, std::memory_order_relaxed);
+	m_recursion = 1;
+	trace::record(trace_event::lock_acquired, this);
+	return true;
 }
 
 void recursive_mutex::unlock()
 {
-	LPCRITICAL_SECTION crit = (LPCRITICAL_SECTION) m_handle;
-	LeaveCriticalSection(crit);
+	if (--m_recursion)
+		return;
+
+	trace::record(trace_event::lock_released, this);
+	m_owner.store(0, std::memory_order_relaxed);
+	if (m_state.exchange(unlocked, std::memory_order_release) == locked_contended)
+		parking_lot::unpark_one(&m_state);
 }
 
 mutex::mutex() noexcept
@@ -0,0 +1,298 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <system_error>
+
+#include <iprog/parallel.hpp>
+#include <iprog/thread.hpp>
+#include <iprog/parking_lot.hpp>
+#include <iprog/fair_mutex.hpp>
+#include <iprog/lock_guard.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+namespace iprog {
+
+// One parallel_run call.  Lives on the caller's stack until every job of it
+// has finished.
+struct parallel_join
+{
+	detail::parallel_body m_body;
+	void* m_context;
+	size_t m_grain;
+
+	// Jobs that have been created but haven't finished yet.
+	std::atomic<size_t> m_pending{ 0 };
+
+	// Set by the first job to throw.  Jobs that haven't started yet skip the
+	// body after that.
+	std::atomic<bool> m_failed{ false };
+	std::exception_ptr m_error;
+};
+
+struct parallel_job
+{
+	parallel_join* m_join;
+	size_t m_lo;
+	size_t m_hi;
+};
+
+// A worker's jobs.  The owner pushes and pops at the back, where the smallest
+// and most recently split pieces are.  Thieves take from the front, where the
+// biggest ones are.
+struct parallel_queue
+{
+	fair_mutex m_mutex;
+	std::deque<parallel_job> m_jobs;
+
+	// Keeps neighbouring queues' locks off this one's cache line.  new[]
+	// won't honour alignas before C++17, so this is padding instead.
+	char m_padding[64];
+};
+
+struct parallel_pool
+{
+	// Only shrinks, and only before the pool is published, if some of the
+	// workers couldn't be started.
+	std::atomic<unsigned> m_worker_count{ 0 };
+
+	// One per worker, and one more shared by every thread that isn't one.
+	parallel_queue* m_queues = nullptr;
+
+	// Bumped whenever a job is pushed, so sleeping workers can tell whether
+	// they missed one.
+	std::atomic<uint32_t> m_signal{ 0 };
+	std::atomic<unsigned> m_sleepers{ 0 };
+};
+
+static std::atomic<parallel_pool*> s_pool{ nullptr };
+
+static fair_mutex s_pool_mutex;
+
+// Zero for one thread per processor.
+static std::atomic<unsigned> s_concurrency{ 0 };
+
+static unsigned pool_threads() noexcept
+{
+	unsigned threads = s_concurrency.load(std::memory_order_relaxed);
+	return threads ? threads : thread::hardware_concurrency();
+}
+
+// The queue owned by the calling thread, if it's a worker.
+static DWORD s_queue_slot = TlsAlloc();
+
+static std::atomic<unsigned> s_steal_start{ 0 };
+
+static parallel_queue* own_queue(parallel_pool* pool)
+{
+	parallel_queue* queue = nullptr;
+	if (s_queue_slot != TLS_OUT_OF_INDEXES)
+		queue = (parallel_queue*) TlsGetValue(s_queue_slot);
+
+	return queue ? queue : &pool->m_queues[pool->m_worker_count.load(std::memory_order_relaxed)];
+}
+
+static void push_job(parallel_pool* pool, parallel_queue* queue, const parallel_job& job)
+{
+	{
+		lock_guard<fair_mutex> lg(queue->m_mutex);
+		queue->m_jobs.push_back(job);
+	}
+
+	// One job only needs one worker.  Waking them all for every split would
+	// have the rest find nothing and go back to sleep.
+	pool->m_signal.fetch_add(1);
+	if (pool->m_sleepers.load() != 0)
+		parking_lot::unpark_one(&pool->m_signal);
+}
+
+// Finds a job, first in our own queue, then in everyone else's.
+static bool take_job(parallel_pool* pool, parallel_queue* own, parallel_job& out)
+{
+	{
+		lock_guard<fair_mutex> lg(own->m_mutex);
+		if (!own->m_jobs.empty()) {
+			out = own->m_jobs.back();
+			own->m_jobs.pop_back();
+			return true;
+		}
+	}
+
+	unsigned queue_count = pool->m_worker_count.load(std::memory_order_relaxed) + 1;
+	unsigned start = s_steal_start.fetch_add(1, std::memory_order_relaxed);
+	for (unsigned i = 0; i < queue_count; i++) {
+		parallel_queue* victim = &pool->m_queues[(start + i) % queue_count];
+		if (victim == own)
+			continue;
+
+		lock_guard<fair_mutex> lg(victim->m_mutex);
+		if (!victim->m_jobs.empty()) {
+			out = victim->m_jobs.front();
+			victim->m_jobs.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void run_job(parallel_pool* pool, parallel_queue* own, parallel_job job)
+{
+	parallel_join* join = job.m_join;
+
+	// Keep splitting off the upper half for someone else until what is left
+	// is small enough to run.
+	while (job.m_hi - job.m_lo > join->m_grain && !join->m_failed.load(std::memory_order_relaxed)) {
+		size_t mid = job.m_lo + (job.m_hi - job.m_lo) / 2;
+		parallel_job upper = { join, mid, job.m_hi };
+		join->m_pending.fetch_add(1, std::memory_order_relaxed);
+		push_job(pool, own, upper);
+		job.m_hi = mid;
+	}
+
+	if (!join->m_failed.load(std::memory_order_relaxed)) {
+		try
+		{
+			join->m_body(join->m_context, job.m_lo, job.m_hi);
+		}
+		catch (...)
+		{
+			bool expected = false;
+			if (join->m_failed.compare_exchange_strong(expected, true))
+				join->m_error = std::current_exception();
+		}
+	}
+
+	// The join may be gone as soon as this hits zero.  unpark_all only uses
+	// the address, so that's fine.
+	if (join->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		parking_lot::unpark_all(&join->m_pending);
+}
+
+static void worker_main(parallel_pool* pool, parallel_queue* own)
+{
+	if (s_queue_slot != TLS_OUT_OF_INDEXES)
+		TlsSetValue(s_queue_slot, own);
+
+	for (;;) {
+		parallel_job job;
+		if (take_job(pool, own, job)) {
+			run_job(pool, own, job);
+			continue;
+		}
+
+		// Announce ourselves before the last look, so that a push either
+		// sees us sleeping or we see its job.
+		uint32_t seen = pool->m_signal.load();
+		pool->m_sleepers.fetch_add(1);
+		if (take_job(pool, own, job)) {
+			pool->m_sleepers.fetch_sub(1);
+			run_job(pool, own, job);
+			continue;
+		}
+
+		parking_lot::park(&pool->m_signal, [pool, seen]() {
+			return pool->m_signal.load() == seen;
+		});
+		pool->m_sleepers.fetch_sub(1);
+	}
+}
+
+static parallel_pool* get_pool()
+{
+	parallel_pool* pool = s_pool.load(std::memory_order_acquire);
+	if (pool)
+		return pool;
+
+	lock_guard<fair_mutex> lg(s_pool_mutex);
+	pool = s_pool.load(std::memory_order_relaxed);
+	if (pool)
+		return pool;
+
+	// The calling thread always helps, so it counts as one of them.
+	unsigned workers = pool_threads();
+	workers = workers > 1 ? workers - 1 : 0;
+
+	pool = new parallel_pool;
+	pool->m_queues = new parallel_queue[workers + 1];
+	pool->m_worker_count.store(workers, std::memory_order_relaxed);
+
+	// The workers run for the rest of the process.  If some can't be
+	// started, make do with the ones that were.
+	for (unsigned i = 0; i < workers; i++) {
+		try
+		{
+			thread worker(&worker_main, pool, &pool->m_queues[i]);
+			worker.detach();
+		}
+		catch (std::system_error&)
+		{
+			// The shared queue becomes the one after the last worker.  The
+			// workers can't have found any jobs yet, so they don't mind.
+			pool->m_worker_count.store(i, std::memory_order_relaxed);
+			break;
+		}
+	}
+
+	s_pool.store(pool, std::memory_order_release);
+	return pool;
+}
+
+void set_parallel_concurrency(unsigned threads)
+{
+	lock_guard<fair_mutex> lg(s_pool_mutex);
+	if (s_pool.load(std::memory_order_relaxed))
+		throw std::system_error(std::make_error_code(std::errc::operation_not_permitted));
+
+	s_concurrency.store(threads, std::memory_order_relaxed);
+}
+
+size_t detail::parallel_default_grain(size_t count) noexcept
+{
+	parallel_pool* pool = s_pool.load(std::memory_order_acquire);
+	size_t threads = pool ? pool->m_worker_count.load(std::memory_order_relaxed) + 1 : pool_threads();
+
+	size_t grain = count / (threads * 8);
+	return grain ? grain : 1;
+}
+
+void detail::parallel_run(parallel_body body, void* context, size_t first, size_t last, size_t grain)
+{
+	parallel_pool* pool = get_pool();
+	parallel_queue* own = own_queue(pool);
+
+	parallel_join join;
+	join.m_body = body;
+	join.m_context = context;
+	join.m_grain = grain;
+	join.m_pending.store(1, std::memory_order_relaxed);
+
+	parallel_job root = { &join, first, last };
+	run_job(pool, own, root);
+
+	// Help out until every piece is done.  Whatever is left in our own queue
+	// must be ours to run, since we only sleep once it is empty.
+	while (join.m_pending.load(std::memory_order_acquire) != 0) {
+		parallel_job job;
+		if (take_job(pool, own, job)) {
+			run_job(pool, own, job);
+			continue;
+		}
+
+		parking_lot::park(&join.m_pending, [&join]() {
+			return join.m_pending.load(std::memory_order_relaxed) != 0;
+		});
+	}
+
+	if (join.m_error)
+		std::rethrow_exception(join.m_error);
+}
+
+} // namespace iprog
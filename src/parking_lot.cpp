@@ -0,0 +1,341 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <atomic>
+
+#include <iprog/parking_lot.hpp>
+#include <iprog/thread.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+namespace iprog {
+
+// A thread sleeping in park().  Lives on that thread's stack.
+struct park_node
+{
+	const void* m_address;
+	park_node* m_next;
+	HANDLE m_event;
+	intptr_t m_token;
+};
+
+// One hash bucket of the parking lot.  Padded to a cache line so that
+// unrelated addresses don't fight over the same line.
+struct alignas(64) park_bucket
+{
+	std::atomic<bool> m_locked;
+
+	// Incremented before validating, so unpark can skip empty buckets
+	// without taking the lock.
+	std::atomic<unsigned> m_waiters;
+
+	park_node* m_head;
+	park_node* m_tail;
+
+	void lock() noexcept {
+		// The lock is only ever held for a few instructions, so spin for a
+		// while and then start giving up our time slice.
+		for (unsigned spins = 0; ; spins++) {
+			if (!m_locked.load(std::memory_order_relaxed) && !m_locked.exchange(true, std::memory_order_acquire))
+				return;
+			if (spins >= 64)
+				Sleep(0);
+		}
+	}
+
+	void unlock() noexcept {
+		m_locked.store(false, std::memory_order_release);
+	}
+
+	void enqueue(park_node* node) noexcept {
+		node->m_next = nullptr;
+		if (m_tail)
+			m_tail->m_next = node;
+		else
+			m_head = node;
+		m_tail = node;
+	}
+
+	// Removes `node` if it is still queued.
+	bool remove(park_node* node) noexcept {
+		park_node* prev = nullptr;
+		for (park_node* cur = m_head; cur; prev = cur, cur = cur->m_next) {
+			if (cur != node)
+				continue;
+
+			unlink(prev, cur);
+			return true;
+		}
+		return false;
+	}
+
+	void unlink(park_node* prev, park_node* node) noexcept {
+		if (prev)
+			prev->m_next = node->m_next;
+		else
+			m_head = node->m_next;
+		if (m_tail == node)
+			m_tail = prev;
+	}
+};
+
+static const size_t bucket_count = 256;
+
+// Zero-initialized, which is the right initial state for every bucket.
+static park_bucket s_buckets[bucket_count];
+
+static park_bucket& bucket_for(const void* address) noexcept
+{
+	// Fibonacci hashing.  The low bits of an address are mostly alignment.
+	uintptr_t key = reinterpret_cast<uintptr_t>(address) >> 2;
+	uint32_t hash = uint32_t(key * 0x9E3779B9u);
+	return s_buckets[hash >> 24];
+}
+
+// Each thread that parks gets one auto-reset event, which lives until the
+// thread exits.  Where there is fiber local storage, its callback closes the
+// event when any thread exits, including ones iprog::thread didn't start.
+// Before Vista there is only TLS, and only iprog::thread's exit hook does.
+typedef VOID (WINAPI *fls_callback_function)(PVOID value);
+typedef DWORD (WINAPI *fls_alloc_function)(fls_callback_function callback);
+typedef PVOID (WINAPI *fls_get_value_function)(DWORD index);
+typedef BOOL (WINAPI *fls_set_value_function)(DWORD index, PVOID value);
+
+struct event_storage
+{
+	DWORD m_index;
+	fls_get_value_function m_fls_get_value;
+	fls_set_value_function m_fls_set_value;
+
+	HANDLE get() const noexcept {
+		return (HANDLE) (m_fls_get_value ? m_fls_get_value(m_index) : TlsGetValue(m_index));
+	}
+
+	void set(HANDLE ev) const noexcept {
+		if (m_fls_set_value)
+			m_fls_set_value(m_index, ev);
+		else
+			TlsSetValue(m_index, ev);
+	}
+};
+
+static VOID WINAPI close_thread_event(PVOID ev)
+{
+	if (ev)
+		CloseHandle((HANDLE) ev);
+}
+
+static event_storage find_event_storage()
+{
+	event_storage storage = { TLS_OUT_OF_INDEXES, nullptr, nullptr };
+
+	HMODULE kernel32 = GetModuleHandleA("kernel32.dll");
+	if (kernel32) {
+		fls_alloc_function fls_alloc = (fls_alloc_function) GetProcAddress(kernel32, "FlsAlloc");
+		fls_get_value_function fls_get_value = (fls_get_value_function) GetProcAddress(kernel32, "FlsGetValue");
+		fls_set_value_function fls_set_value = (fls_set_value_function) GetProcAddress(kernel32, "FlsSetValue");
+
+		if (fls_alloc && fls_get_value && fls_set_value) {
+			// FLS_OUT_OF_INDEXES has the same value.
+			storage.m_index = fls_alloc(&close_thread_event);
+			if (storage.m_index != TLS_OUT_OF_INDEXES) {
+				storage.m_fls_get_value = fls_get_value;
+				storage.m_fls_set_value = fls_set_value;
+				return storage;
+			}
+		}
+	}
+
+	storage.m_index = TlsAlloc();
+	return storage;
+}
+
+static const event_storage s_event_storage = find_event_storage();
+
+static void release_thread_event()
+{
+	// FLS cleans up after itself.
+	if (s_event_storage.m_fls_get_value || s_event_storage.m_index == TLS_OUT_OF_INDEXES)
+		return;
+
+	HANDLE ev = s_event_storage.get();
+	if (!ev)
+		return;
+
+	s_event_storage.set(nullptr);
+	CloseHandle(ev);
+}
+
+static bool s_hook_added = (detail::add_thread_exit_hook(&release_thread_event), true);
+
+static HANDLE thread_event()
+{
+	if (s_event_storage.m_index == TLS_OUT_OF_INDEXES)
+		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+
+	HANDLE ev = s_event_storage.get();
+	if (ev)
+		return ev;
+
+	ev = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (!ev)
+		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+
+	s_event_storage.set(ev);
+	return ev;
+}
+
+park_result parking_lot::park_impl(const void* address, bool (*validate)(void*), void* validate_context,
+	void (*before_sleep)(void*), void* before_sleep_context, uint32_t timeout_ms)
+{
+	park_node node;
+	node.m_address = address;
+	node.m_next = nullptr;
+	node.m_event = thread_event();
+	node.m_token = 0;
+
+	park_bucket& b = bucket_for(address);
+	b.m_waiters.fetch_add(1, std::memory_order_seq_cst);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	b.lock();
+
+	if (!validate(validate_context)) {
+		b.unlock();
+		b.m_waiters.fetch_sub(1, std::memory_order_relaxed);
+		park_result result = { park_status::invalid, 0 };
+		return result;
+	}
+
+	b.enqueue(&node);
+	b.unlock();
+
+	if (before_sleep)
+		before_sleep(before_sleep_context);
+
+	DWORD ret = WaitForSingleObject(node.m_event, (DWORD) timeout_ms);
+	if (ret != WAIT_OBJECT_0) {
+		b.lock();
+		bool removed = b.remove(&node);
+		b.unlock();
+
+		if (removed) {
+			b.m_waiters.fetch_sub(1, std::memory_order_relaxed);
+			park_result result = { park_status::timed_out, 0 };
+			return result;
+		}
+
+		// Someone took us off the queue just as we timed out.  They are about
+		// to signal our event, so wait for that, or the next park() would see
+		// a stale wakeup.
+		WaitForSingleObject(node.m_event, INFINITE);
+	}
+
+	park_result result = { park_status::unparked, node.m_token };
+	return result;
+}
+
+unpark_result parking_lot::unpark_one_impl(const void* address, intptr_t (*callback)(void*, unpark_result), void* context)
+{
+	unpark_result result = { false, false };
+	park_bucket& b = bucket_for(address);
+
+	// Pairs with the increment in park_impl: either we see the waiter, or
+	// it sees whatever the caller stored before notifying us.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (b.m_waiters.load(std::memory_order_relaxed) == 0 && !callback)
+		return result;
+
+	b.lock();
+
+	park_node* prev = nullptr;
+	park_node* found = b.m_head;
+	while (found && found->m_address != address) {
+		prev = found;
+		found = found->m_next;
+	}
+
+	if (found) {
+		b.unlink(prev, found);
+		result.unparked_thread = true;
+
+		for (park_node* cur = found->m_next; cur; cur = cur->m_next) {
+			if (cur->m_address == address) {
+				result.have_more_threads = true;
+				break;
+			}
+		}
+	}
+
+	intptr_t token = callback ? callback(context, result) : 0;
+
+	HANDLE ev = nullptr;
+	if (found) {
+		found->m_token = token;
+		ev = found->m_event;
+		b.m_waiters.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	b.unlock();
+
+	// The woken thread can't leave park() until this is signalled, so the
+	// handle is still good.
+	if (ev)
+		SetEvent(ev);
+
+	return result;
+}
+
+size_t parking_lot::unpark_all(const void* address, intptr_t token)
+{
+	park_bucket& b = bucket_for(address);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (b.m_waiters.load(std::memory_order_relaxed) == 0)
+		return 0;
+
+	b.lock();
+
+	park_node* woken = nullptr;
+	park_node* woken_tail = nullptr;
+	size_t count = 0;
+
+	park_node* prev = nullptr;
+	park_node* cur = b.m_head;
+	while (cur) {
+		park_node* next = cur->m_next;
+		if (cur->m_address != address) {
+			prev = cur;
+			cur = next;
+			continue;
+		}
+
+		b.unlink(prev, cur);
+		cur->m_token = token;
+		cur->m_next = nullptr;
+		if (woken_tail)
+			woken_tail->m_next = cur;
+		else
+			woken = cur;
+		woken_tail = cur;
+		count++;
+		cur = next;
+	}
+
+	b.m_waiters.fetch_sub(unsigned(count), std::memory_order_relaxed);
+	b.unlock();
+
+	while (woken) {
+		// Read the next pointer first, the node goes away once woken.
+		park_node* next = woken->m_next;
+		SetEvent(woken->m_event);
+		woken = next;
+	}
+
+	return count;
+}
+
+} // namespace iprog
@@ -0,0 +1,76 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <vector>
+#include <system_error>
+
+#include <iprog/per_thread.hpp>
+#include <iprog/thread.hpp>
+#include <iprog/fair_mutex.hpp>
+#include <iprog/lock_guard.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+namespace iprog {
+namespace detail {
+
+// Holds the thread's slot plus one, so that zero means "none yet".
+static DWORD s_slot_tls = TlsAlloc();
+
+static fair_mutex s_slot_mutex;
+
+static std::vector<size_t> s_free_slots;
+
+static size_t s_next_slot = 0;
+
+static void release_thread_slot()
+{
+	size_t slot = (size_t) TlsGetValue(s_slot_tls);
+	if (!slot)
+		return;
+
+	TlsSetValue(s_slot_tls, nullptr);
+
+	lock_guard<fair_mutex> lg(s_slot_mutex);
+	s_free_slots.push_back(slot - 1);
+}
+
+static bool s_hook_added = (add_thread_exit_hook(&release_thread_slot), true);
+
+size_t this_thread_slot()
+{
+	size_t slot = (size_t) TlsGetValue(s_slot_tls);
+	if (slot)
+		return slot - 1;
+
+	if (s_slot_tls == TLS_OUT_OF_INDEXES)
+		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+
+	{
+		// Reuse the lowest numbers first, to keep the per_thread tables small.
+		lock_guard<fair_mutex> lg(s_slot_mutex);
+		if (s_free_slots.empty()) {
+			slot = s_next_slot++;
+		}
+		else {
+			std::vector<size_t>::iterator lowest = s_free_slots.begin();
+			for (std::vector<size_t>::iterator it = s_free_slots.begin(); it != s_free_slots.end(); ++it) {
+				if (*it < *lowest)
+					lowest = it;
+			}
+			slot = *lowest;
+			*lowest = s_free_slots.back();
+			s_free_slots.pop_back();
+		}
+	}
+
+	TlsSetValue(s_slot_tls, (LPVOID) (slot + 1));
+	return slot;
+}
+
+} // namespace detail
+} // namespace iprog
@@ -0,0 +1,109 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <system_error>
+
+#include <iprog/rate_limiter.hpp>
+#include <iprog/thread.hpp>
+#include <iprog/ticks.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+namespace iprog {
+
+// The earliest time, no earlier than `now`, at which `cost` fits in a bucket
+// that is full at `full_at`.
+static int64_t earliest(int64_t full_at, int64_t cost, int64_t tolerance, int64_t now)
+{
+	int64_t at = full_at + cost - tolerance;
+	return at > now ? at : now;
+}
+
+rate_limiter::rate_limiter(double rate, double burst)
+{
+	if (!(rate > 0) || !(burst >= 1))
+		throw std::system_error(std::make_error_code(std::errc::invalid_argument));
+
+	m_interval = int64_t(double(detail::tick_frequency()) / rate);
+	if (m_interval < 1)
+		m_interval = 1;
+
+	m_tolerance = int64_t(double(m_interval) * burst);
+}
+
+void rate_limiter::refund(int64_t n) noexcept
+{
+	// Anyone who reserved after us keeps their slot.  The one we leave
+	// behind goes to whoever comes next.
+	m_full_at.fetch_sub(n * m_interval, std::memory_order_relaxed);
+}
+
+bool rate_limiter::reserve(rate_limiter* a, rate_limiter* also, int64_t n, int64_t max_wait_ns, bool wait)
+{
+	if (n <= 0)
+		return true;
+
+	int64_t max_wait = max_wait_ns < 0 ? -1 : detail::ns_to_ticks(max_wait_ns);
+	int64_t cost_a = n * a->m_interval;
+	int64_t cost_also = also ? n * also->m_interval : 0;
+
+	int64_t at;
+	for (;;) {
+		int64_t now = detail::now_ticks();
+		int64_t full_a = a->m_full_at.load(std::memory_order_relaxed);
+		int64_t full_also = also ? also->m_full_at.load(std::memory_order_relaxed) : 0;
+
+		// Both at the same moment, so neither bucket sees us earlier than
+		// the other lets us through.
+		at = earliest(full_a, cost_a, a->m_tolerance, now);
+		if (also) {
+			int64_t at_also = earliest(full_also, cost_also, also->m_tolerance, now);
+			if (at_also > at)
+				at = at_also;
+		}
+
+		if (max_wait >= 0 && at - now > max_wait)
+			return false;
+
+		int64_t next_a = (full_a > at ? full_a : at) + cost_a;
+		if (!a->m_full_at.compare_exchange_weak(full_a, next_a, std::memory_order_relaxed))
+			continue;
+
+		if (!also)
+			break;
+
+		int64_t next_also = (full_also > at ? full_also : at) + cost_also;
+		if (also->m_full_at.compare_exchange_strong(full_also, next_also, std::memory_order_relaxed))
+			break;
+
+		// Someone got to the other bucket first, so the moment we picked may
+		// not work anymore.  Put back ours and start over.  If someone has
+		// reserved after us in the meantime, take back exactly what we
+		// added, which is more than cost_a if the bucket had gone idle.
+		int64_t expected = next_a;
+		if (!a->m_full_at.compare_exchange_strong(expected, full_a, std::memory_order_relaxed))
+			a->m_full_at.fetch_sub(next_a - full_a, std::memory_order_relaxed);
+	}
+
+	if (!wait)
+		return true;
+
+	// Our slot is set aside, so this is one sleep, not a poll.
+	int64_t ticks_per_ms = detail::ticks_per_ms();
+
+	for (;;) {
+		int64_t left = at - detail::now_ticks();
+		if (left <= 0)
+			break;
+
+		this_thread::sleep_for(std::chrono::milliseconds((left + ticks_per_ms - 1) / ticks_per_ms));
+	}
+
+	return true;
+}
+
+} // namespace iprog
@@ -0,0 +1,113 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <iprog/stop_token.hpp>
+#include <iprog/lock_guard.hpp>
+#include <iprog/atomic_wait.hpp>
+
+namespace iprog {
+namespace detail {
+
+bool stop_state::request_stop()
+{
+	m_mutex.lock();
+	if (m_requested.load(std::memory_order_relaxed)) {
+		m_mutex.unlock();
+		return false;
+	}
+
+	m_requested.store(true, std::memory_order_release);
+	m_requester = this_thread::get_id();
+
+	// Run the callbacks one at a time, outside of the lock, so that they may
+	// register or destroy other callbacks on the same state.
+	while (m_head) {
+		stop_callback_node* node = m_head;
+		m_head = node->m_next;
+		if (m_head)
+			m_head->m_prev = nullptr;
+		node->m_linked = false;
+
+		bool destroyed = false;
+		node->m_destroyed = &destroyed;
+		m_running = node;
+		m_mutex.unlock();
+
+		node->m_invoke(node->m_context);
+
+		// If the callback destroyed its own stop_callback, the node is gone.
+		// Otherwise another thread may be blocked destroying it, and may free
+		// it as soon as m_done is set; the parking lot only uses the address
+		// as a key, so notifying afterwards is fine.
+		if (!destroyed) {
+			node->m_destroyed = nullptr;
+			node->m_done.store(true, std::memory_order_release);
+			atomic_notify_all(&node->m_done);
+		}
+
+		m_mutex.lock();
+	}
+
+	m_running = nullptr;
+	m_mutex.unlock();
+	return true;
+}
+
+bool stop_state::add_callback(stop_callback_node* node)
+{
+	lock_guard<mutex> lg(m_mutex);
+	if (m_requested.load(std::memory_order_relaxed))
+		return false;
+
+	node->m_prev = nullptr;
+	node->m_next = m_head;
+	if (m_head)
+		m_head->m_prev = node;
+	m_head = node;
+	node->m_linked = true;
+	return true;
+}
+
+void stop_state::remove_callback(stop_callback_node* node)
+{
+	m_mutex.lock();
+
+	if (node->m_linked) {
+		// Not run yet; just unlink it.
+		if (node->m_prev)
+			node->m_prev->m_next = node->m_next;
+		else
+			m_head = node->m_next;
+		if (node->m_next)
+			node->m_next->m_prev = node->m_prev;
+		node->m_linked = false;
+		m_mutex.unlock();
+		return;
+	}
+
+	if (m_running != node) {
+		// Already finished running.
+		m_mutex.unlock();
+		return;
+	}
+
+	// It is running right now.  If it is being destroyed from inside its own
+	// callback, tell request_stop() not to touch it again.
+	if (m_requester == this_thread::get_id()) {
+		if (node->m_destroyed)
+			*node->m_destroyed = true;
+		m_mutex.unlock();
+		return;
+	}
+
+	m_mutex.unlock();
+
+	// Otherwise block until the callback returns on the requesting thread.
+	atomic_wait(&node->m_done, false, std::memory_order_acquire);
+}
+
+} // namespace detail
+} // namespace iprog
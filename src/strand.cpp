@@ -0,0 +1,32 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <iprog/strand.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+namespace iprog {
+
+// Without a slot, no thread is ever in a strand, so dispatch() from inside
+// one queues instead of calling right away.  Still in order, just slower.
+static DWORD s_current_slot = TlsAlloc();
+
+void* detail::strand_current() noexcept
+{
+	if (s_current_slot == TLS_OUT_OF_INDEXES)
+		return nullptr;
+
+	return TlsGetValue(s_current_slot);
+}
+
+void detail::strand_set_current(void* state) noexcept
+{
+	if (s_current_slot != TLS_OUT_OF_INDEXES)
+		TlsSetValue(s_current_slot, state);
+}
+
+} // namespace iprog
@@ -5,6 +5,9 @@
 //
 
 #include <iprog/thread.hpp>
+#include <iprog/fair_mutex.hpp>
+#include <iprog/lock_guard.hpp>
+#include <iprog/ticks.hpp>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -15,10 +18,199 @@
 #	include <process.h>
 #endif
 
+#include <atomic>
+#include <new>
+
 namespace iprog {
 
-thread::native_handle_type thread::create_thread(void* invokeptr, void* params, size_t& out_id) noexcept
+namespace detail {
+
+static const unsigned max_thread_exit_hooks = 16;
+
+static std::atomic<thread_exit_hook> s_exit_hooks[max_thread_exit_hooks];
+
+static std::atomic<unsigned> s_exit_hook_count{ 0 };
+
+void add_thread_exit_hook(thread_exit_hook hook) noexcept
+{
+	// Hooks are only ever added once per subsystem, so this never fills up.
+	unsigned index = s_exit_hook_count.fetch_add(1);
+	if (index >= max_thread_exit_hooks)
+		terminateIprogsThreads();
+
+	s_exit_hooks[index].store(hook, std::memory_order_release);
+}
+
+void run_thread_exit_hooks() noexcept
+{
+	unsigned count = s_exit_hook_count.load(std::memory_order_acquire);
+	if (count > max_thread_exit_hooks)
+		count = max_thread_exit_hooks;
+
+	for (unsigned i = 0; i < count; i++) {
+		thread_exit_hook hook = s_exit_hooks[i].load(std::memory_order_acquire);
+		if (hook)
+			hook();
+	}
+}
+
+} // namespace detail
+
+typedef void (__stdcall *invoker_type)(void*);
+
+// An OS thread which runs the functions of several thread objects in turn.
+struct cached_thread
+{
+	enum {
+		running,  // running a function for a thread object
+		finished, // function returned, thread object not joined yet
+		detached, // thread object detached while the function was running
+	};
+
+	HANDLE m_handle = NULL;
+	unsigned m_id = 0;
+
+	// Signalled when m_invoker is set to the next function to run.  A null
+	// m_invoker means the thread should exit.
+	HANDLE m_start = NULL;
+
+	// Signalled when the function returns, unless the thread was detached.
+	HANDLE m_done = NULL;
+
+	invoker_type m_invoker = nullptr;
+	void* m_params = nullptr;
+
+	std::atomic<int> m_state{ running };
+
+	cached_thread* m_next = nullptr;
+};
+
+static fair_mutex s_cache_mutex;
+
+static cached_thread* s_idle_threads = nullptr;
+
+static unsigned s_idle_count = 0;
+
+static std::atomic<unsigned> s_cache_limit{ 0 };
+
+static void destroy_cached_thread(cached_thread* ct)
+{
+	if (ct->m_start)
+		CloseHandle(ct->m_start);
+	if (ct->m_done)
+		CloseHandle(ct->m_done);
+	delete ct;
+}
+
+// Tells an idle cached thread to exit.
+static void retire_cached_thread(cached_thread* ct)
+{
+	ct->m_invoker = nullptr;
+	SetEvent(ct->m_start);
+}
+
+// Puts a cached thread whose function has returned back in the cache, or
+// lets it exit if the cache is full.
+static void recycle_cached_thread(cached_thread* ct)
 {
+	{
+		lock_guard<fair_mutex> lg(s_cache_mutex);
+		if (s_idle_count < s_cache_limit.load(std::memory_order_relaxed)) {
+			ct->m_next = s_idle_threads;
+			s_idle_threads = ct;
+			s_idle_count++;
+			return;
+		}
+	}
+
+	retire_cached_thread(ct);
+}
+
+static unsigned __stdcall cached_thread_main(void* param)
+{
+	cached_thread* ct = static_cast<cached_thread*>(param);
+
+	for (;;) {
+		WaitForSingleObject(ct->m_start, INFINITE);
+		if (!ct->m_invoker)
+			break;
+
+		ct->m_invoker(ct->m_params);
+
+		int expected = cached_thread::running;
+		if (ct->m_state.compare_exchange_strong(expected, cached_thread::finished)) {
+			// Whoever joins us will recycle us.
+			SetEvent(ct->m_done);
+			continue;
+		}
+
+		// Detached while running, so nobody else will.
+		recycle_cached_thread(ct);
+	}
+
+	CloseHandle(ct->m_handle);
+	destroy_cached_thread(ct);
+	return 0;
+}
+
+static cached_thread* start_cached_thread(invoker_type invoker, void* params) noexcept
+{
+	cached_thread* ct = nullptr;
+	{
+		lock_guard<fair_mutex> lg(s_cache_mutex);
+		if (s_idle_threads) {
+			ct = s_idle_threads;
+			s_idle_threads = ct->m_next;
+			s_idle_count--;
+		}
+	}
+
+	if (ct) {
+		ct->m_invoker = invoker;
+		ct->m_params = params;
+		ct->m_state.store(cached_thread::running, std::memory_order_relaxed);
+		SetEvent(ct->m_start);
+		return ct;
+	}
+
+	ct = new (std::nothrow) cached_thread;
+	if (!ct)
+		return nullptr;
+
+	ct->m_start = CreateEvent(NULL, FALSE, FALSE, NULL);
+	ct->m_done = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (!ct->m_start || !ct->m_done) {
+		destroy_cached_thread(ct);
+		return nullptr;
+	}
+
+	ct->m_invoker = invoker;
+	ct->m_params = params;
+
+	// The thread can't look at m_handle until it has been told to exit, which
+	// only happens after it's been handed out, so this doesn't race.
+	ct->m_handle = (HANDLE) _beginthreadex(NULL, 0, cached_thread_main, ct, 0, &ct->m_id);
+	if (!ct->m_handle) {
+		destroy_cached_thread(ct);
+		return nullptr;
+	}
+
+	SetEvent(ct->m_start);
+	return ct;
+}
+
+thread::native_handle_type thread::create_thread(void* invokeptr, void* params, size_t& out_id, void*& out_cached) noexcept
+{
+	out_cached = nullptr;
+
+	// If the cache is on, run on a cached thread instead.
+	if (s_cache_limit.load(std::memory_order_relaxed) != 0) {
+		cached_thread* ct = start_cached_thread((invoker_type) invokeptr, params);
+		out_id = ct ? (size_t) ct->m_id : 0;
+		out_cached = ct;
+		return ct ? (native_handle_type) ct->m_handle : nullptr;
+	}
+
 	// Create the actual thread.
 	unsigned threadId = 0;
 	HANDLE hnd = (HANDLE) _beginthreadex(NULL, 0, (_beginthreadex_proc_type)invokeptr, params, 0, &threadId);
@@ -31,6 +223,29 @@ thread::native_handle_type thread::create_thread(void* invokeptr, void* params,
 	return (native_handle_type) hnd;
 }
 
+void thread::set_cache_limit(unsigned max_idle) noexcept
+{
+	cached_thread* excess = nullptr;
+	{
+		lock_guard<fair_mutex> lg(s_cache_mutex);
+		s_cache_limit.store(max_idle, std::memory_order_relaxed);
+
+		while (s_idle_count > max_idle) {
+			cached_thread* ct = s_idle_threads;
+			s_idle_threads = ct->m_next;
+			s_idle_count--;
+			ct->m_next = excess;
+			excess = ct;
+		}
+	}
+
+	while (excess) {
+		cached_thread* next = excess->m_next;
+		retire_cached_thread(excess);
+		excess = next;
+	}
+}
+
 void thread::join()
 {
 	if (!joinable()) {
@@ -40,6 +255,17 @@ void thread::join()
 
 	// TODO: check against this thread
 
+	if (m_cached) {
+		// Wait for the function to return, then give the OS thread back.
+		cached_thread* ct = static_cast<cached_thread*>(m_cached);
+		WaitForSingleObject(ct->m_done, INFINITE);
+		recycle_cached_thread(ct);
+		m_cached = nullptr;
+		m_handle = 0;
+		m_id = id();
+		return;
+	}
+
 	// Wait for the thread to exit.
 	WaitForSingleObject(m_handle, INFINITE);
 
@@ -58,6 +284,20 @@ void thread::detach()
 
 	// TODO: check against this thread
 
+	if (m_cached) {
+		cached_thread* ct = static_cast<cached_thread*>(m_cached);
+		int expected = cached_thread::running;
+		if (!ct->m_state.compare_exchange_strong(expected, cached_thread::detached)) {
+			// Already finished.  Eat the done signal and give it back ourselves.
+			WaitForSingleObject(ct->m_done, INFINITE);
+			recycle_cached_thread(ct);
+		}
+		m_cached = nullptr;
+		m_handle = 0;
+		m_id = id();
+		return;
+	}
+
 	// Close the handle to the thread.  It will keep running.
 	CloseHandle(m_handle);
 	m_handle = 0;
@@ -66,8 +306,11 @@ void thread::detach()
 
 unsigned int thread::hardware_concurrency() noexcept
 {
-	// TODO
-	return 4;
+	// Only counts the processors in our group, but that's the most we can
+	// be scheduled on without asking anyway.
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return si.dwNumberOfProcessors ? (unsigned int) si.dwNumberOfProcessors : 1;
 }
 
 thread::id this_thread::get_id() noexcept
@@ -75,9 +318,211 @@ thread::id this_thread::get_id() noexcept
 	return thread::id(GetCurrentThreadId());
 }
 
+void this_thread::yield() noexcept
+{
+	// SwitchToThread would be nicer, but it doesn't exist on 9x.
+	Sleep(0);
+}
+
+// How much an OS sleep overshoots by, in performance counter ticks: a running
+// average in the high half, and the average deviation in the low half.  Kept
+// in one word so that racing updates can't leave a mix of two.  Zero until
+// the first precise sleep has been timed.
+static std::atomic<uint64_t> s_overshoot{ 0 };
+
+// Until then, assume about one default scheduler tick (15.6ms), so the first
+// sleeps are accurate, if expensive.
+static void unpack_overshoot(uint64_t packed, int64_t& mean, int64_t& dev)
+{
+	if (!packed) {
+		mean = detail::tick_frequency() / 128;
+		dev = detail::tick_frequency() / 256;
+		return;
+	}
+
+	mean = int64_t(packed >> 32);
+	dev = int64_t(packed & 0xFFFFFFFF);
+}
+
+static void record_overshoot(int64_t overshoot)
+{
+	// A suspend, a debugger break, or being preempted for long, says nothing
+	// about the timer.  Without a cap, one of those would have every precise
+	// sleep after it spin for as long.  Two scheduler ticks is plenty for a
+	// real overshoot, and fits in half a word.
+	int64_t limit = detail::tick_frequency() / 32;
+	if (limit > 0xFFFFFFFF)
+		limit = 0xFFFFFFFF;
+	if (overshoot < 0)
+		overshoot = 0;
+	if (overshoot > limit)
+		overshoot = limit;
+
+	uint64_t packed = s_overshoot.load(std::memory_order_relaxed);
+	uint64_t next;
+	do {
+		int64_t mean, dev;
+		unpack_overshoot(packed, mean, dev);
+
+		int64_t diff = overshoot - mean;
+		mean += diff / 8;
+		dev += ((diff < 0 ? -diff : diff) - dev) / 8;
+		if (mean > limit)
+			mean = limit;
+		if (dev > limit)
+			dev = limit;
+
+		// Zero means not measured yet, so never store it.
+		next = (uint64_t(mean) << 32) | uint64_t(dev);
+		if (!next)
+			next = 1;
+	}
+	while (!s_overshoot.compare_exchange_weak(packed, next, std::memory_order_relaxed));
+}
+
 void this_thread::perform_sleep(uint32_t ms) noexcept
 {
+	if (ms == 0) {
+		Sleep(0);
+		return;
+	}
+
+	trace::record(trace_event::sleep_begin, nullptr, uint64_t(ms) * 1000000);
+	Sleep((DWORD) ms);
+	trace::record(trace_event::sleep_end, nullptr);
+}
+
+void this_thread::perform_precise_sleep(int64_t ns, int64_t spin_budget_ns) noexcept
+{
+	trace::record(trace_event::sleep_begin, nullptr, (uint64_t) ns);
+
+	int64_t start = detail::now_ticks();
+	int64_t deadline = start + detail::ns_to_ticks(ns);
+	int64_t spin_budget = detail::ns_to_ticks(spin_budget_ns);
+	int64_t ticks_per_ms = detail::ticks_per_ms();
+
+	// Coarse phase.  Sleep for all but the expected overshoot plus the spin
+	// budget, and learn from how long it actually took.
+	int64_t now = start;
+	for (;;) {
+		int64_t mean, dev;
+		unpack_overshoot(s_overshoot.load(std::memory_order_relaxed), mean, dev);
+
+		int64_t margin = mean + 2 * dev + spin_budget;
+		int64_t left = deadline - now;
+		if (left <= margin)
+			break;
+
+		int64_t ms = (left - margin) / ticks_per_ms;
+		if (ms <= 0)
+			break;
+		if (ms >= __infinite)
+			ms = __infinite - 1;
+
+		Sleep((DWORD) ms);
+
+		int64_t after = detail::now_ticks();
+		record_overshoot(after - now - ms * ticks_per_ms);
+		now = after;
+	}
+
+	// Fine phase.  Stay runnable until the deadline.
+	while (now < deadline) {
+		Sleep(0);
+		now = detail::now_ticks();
+	}
+
+	trace::record(trace_event::sleep_end, nullptr);
+}
+
+// SetWaitableTimerEx, from Windows 7 on, takes how late the timer may fire,
+// which lets the kernel fire timers that are due around the same time
+// together.  Both functions are looked up, so that older systems still load.
+typedef HANDLE (WINAPI *create_waitable_timer_ex_function)(void* attributes, const wchar_t* name, DWORD flags, DWORD access);
+typedef BOOL (WINAPI *set_waitable_timer_ex_function)(HANDLE timer, const LARGE_INTEGER* due_time, LONG period,
+	void* completion_routine, void* completion_arg, void* wake_context, ULONG tolerable_delay);
+
+struct coalescing_timer_functions
+{
+	create_waitable_timer_ex_function m_create;
+	set_waitable_timer_ex_function m_set;
+};
+
+static coalescing_timer_functions find_coalescing_timer_functions()
+{
+	coalescing_timer_functions functions = { nullptr, nullptr };
+
+	HMODULE kernel32 = GetModuleHandleA("kernel32.dll");
+	if (!kernel32)
+		return functions;
+
+	functions.m_create = (create_waitable_timer_ex_function) GetProcAddress(kernel32, "CreateWaitableTimerExW");
+	functions.m_set = (set_waitable_timer_ex_function) GetProcAddress(kernel32, "SetWaitableTimerEx");
+	if (!functions.m_create || !functions.m_set) {
+		functions.m_create = nullptr;
+		functions.m_set = nullptr;
+	}
+
+	return functions;
+}
+
+static const coalescing_timer_functions s_coalescing_timer = find_coalescing_timer_functions();
+
+// Sleeps on a one-shot timer that may fire up to `tolerable_delay_ms` late.
+// Returns false if there is no such timer, or it couldn't be set.
+static bool coalescing_timer_sleep(int64_t ns, int64_t tolerable_delay_ms) noexcept
+{
+	if (!s_coalescing_timer.m_create || tolerable_delay_ms <= 0)
+		return false;
+
+	HANDLE timer = s_coalescing_timer.m_create(NULL, NULL, 0, TIMER_MODIFY_STATE | SYNCHRONIZE);
+	if (!timer)
+		return false;
+
+	// Negative means relative, in 100ns units.
+	LARGE_INTEGER due;
+	due.QuadPart = -((ns + 99) / 100);
+	if (due.QuadPart == 0)
+		due.QuadPart = -1;
+
+	if (tolerable_delay_ms > 0x7FFFFFFF)
+		tolerable_delay_ms = 0x7FFFFFFF;
+
+	bool ok = s_coalescing_timer.m_set(timer, &due, 0, NULL, NULL, NULL, (ULONG) tolerable_delay_ms) != FALSE;
+	if (ok)
+		WaitForSingleObject(timer, INFINITE);
+
+	CloseHandle(timer);
+	return ok;
+}
+
+void this_thread::perform_coalescable_sleep(int64_t ns, int64_t slack_ns) noexcept
+{
+	trace::record(trace_event::sleep_begin, nullptr, (uint64_t) ns);
+
+	if (coalescing_timer_sleep(ns, slack_ns / 1000000)) {
+		trace::record(trace_event::sleep_end, nullptr);
+		return;
+	}
+
+	// Best effort.  Round the deadline up to the next multiple of the slack,
+	// so that everyone using the same slack at least asks to wake at the same
+	// time, since the counter is system-wide.  Whether they actually do is up
+	// to how Sleep lines up with the timer tick.
+	int64_t now = detail::now_ticks();
+	int64_t deadline = now + detail::ns_to_ticks(ns);
+	int64_t slack = detail::ns_to_ticks(slack_ns);
+	if (slack > 1)
+		deadline = (deadline + slack - 1) / slack * slack;
+
+	int64_t ticks_per_ms = detail::ticks_per_ms();
+
+	int64_t ms = (deadline - now + ticks_per_ms - 1) / ticks_per_ms;
+	if (ms >= __infinite)
+		ms = __infinite - 1;
+
 	Sleep((DWORD) ms);
+	trace::record(trace_event::sleep_end, nullptr);
 }
 
 } // namespace iprog
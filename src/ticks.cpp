@@ -0,0 +1,53 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <atomic>
+
+#include <iprog/ticks.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+namespace iprog {
+
+// Zero until first asked for.  A static initialized with a function call
+// could be read by another file's static initializers before it is set.
+static std::atomic<int64_t> s_frequency{ 0 };
+
+int64_t detail::tick_frequency() noexcept
+{
+	int64_t frequency = s_frequency.load(std::memory_order_relaxed);
+	if (frequency)
+		return frequency;
+
+	// Racing threads all get the same answer, so whoever stores it is fine.
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	s_frequency.store(freq.QuadPart, std::memory_order_relaxed);
+	return freq.QuadPart;
+}
+
+int64_t detail::ticks_per_ms() noexcept
+{
+	int64_t ticks = tick_frequency() / 1000;
+	return ticks > 0 ? ticks : 1;
+}
+
+int64_t detail::now_ticks() noexcept
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+// Converts in two halves so that long intervals don't overflow.
+int64_t detail::ns_to_ticks(int64_t ns) noexcept
+{
+	int64_t frequency = tick_frequency();
+	return (ns / 1000000000) * frequency + (ns % 1000000000) * frequency / 1000000000;
+}
+
+} // namespace iprog
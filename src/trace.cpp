@@ -0,0 +1,411 @@
+//
+//  iProgramInCpp's Thread Implementation for Windows
+//
+//  Copyright (C) 2024 iProgramInCpp.  Licensed under the MIT license.
+//
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <ostream>
+#include <system_error>
+#include <vector>
+
+#include <iprog/trace.hpp>
+#include <iprog/thread.hpp>
+#include <iprog/fair_mutex.hpp>
+#include <iprog/lock_guard.hpp>
+#include <iprog/ticks.hpp>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+// Every buffer here is big enough, so the missing terminator on overflow
+// never matters.
+#define snprintf _snprintf
+#endif
+
+namespace iprog {
+
+std::atomic<bool> trace::s_enabled{ false };
+
+struct trace_entry
+{
+	int64_t m_ticks;
+	const void* m_object;
+	uint64_t m_arg;
+	trace_event m_event;
+};
+
+// One thread's events.  Only the owning thread writes to it.  Rings are never
+// freed, so the events of threads that have exited can still be exported.
+// The ring of an exited thread is handed to the next thread that needs one
+// once it has been cleared or exported, or once too many exited threads are
+// being kept.
+struct trace_ring
+{
+	enum {
+		live,
+		exited,
+		unused,
+	};
+
+	// These only change under s_trace_mutex.
+	DWORD m_thread_id = 0;
+	char m_name[64] = {};
+	bool m_exported = false;
+
+	// When the owner exited, counting from the first thread to exit.
+	std::atomic<uint64_t> m_exit_order{ 0 };
+
+	// The index of the next event to be written, counting from the first
+	// event ever written to this ring.
+	std::atomic<uint64_t> m_head{ 0 };
+
+	// Events before this index were cleared.
+	std::atomic<uint64_t> m_floor{ 0 };
+
+	std::atomic<int> m_state{ live };
+
+	trace_entry m_entries[trace::events_per_thread];
+
+	trace_ring* m_next = nullptr;
+};
+
+static_assert((trace::events_per_thread & (trace::events_per_thread - 1)) == 0, "events_per_thread must be a power of two");
+
+// Guards thread names and ring ownership changes.  Never held while
+// recording an event.
+static fair_mutex s_trace_mutex;
+
+static std::atomic<trace_ring*> s_rings{ nullptr };
+
+static DWORD s_ring_slot = TlsAlloc();
+
+static std::atomic<int64_t> s_base_ticks{ 0 };
+
+static std::atomic<uint64_t> s_exit_count{ 0 };
+
+static void release_ring()
+{
+	if (s_ring_slot == TLS_OUT_OF_INDEXES)
+		return;
+
+	trace_ring* ring = (trace_ring*) TlsGetValue(s_ring_slot);
+	if (!ring)
+		return;
+
+	TlsSetValue(s_ring_slot, nullptr);
+	ring->m_exit_order.store(s_exit_count.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+	ring->m_state.store(trace_ring::exited, std::memory_order_release);
+}
+
+static bool s_hook_added = (detail::add_thread_exit_hook(&release_ring), true);
+
+// Finds a ring that a new thread can have, or returns null.  Called with
+// s_trace_mutex held, which every change away from `exited` is made under.
+static trace_ring* take_free_ring() noexcept
+{
+	trace_ring* oldest = nullptr;
+	size_t exited = 0;
+
+	for (trace_ring* ring = s_rings.load(std::memory_order_acquire); ring; ring = ring->m_next) {
+		int state = ring->m_state.load(std::memory_order_acquire);
+		if (state == trace_ring::live)
+			continue;
+
+		// Cleared, or exported after its thread exited.  Nothing is lost.
+		if (state == trace_ring::unused || ring->m_exported) {
+			ring->m_state.store(trace_ring::live, std::memory_order_relaxed);
+			return ring;
+		}
+
+		exited++;
+		if (!oldest || ring->m_exit_order.load(std::memory_order_relaxed) < oldest->m_exit_order.load(std::memory_order_relaxed))
+			oldest = ring;
+	}
+
+	// Too many exited threads are being kept, so the one that exited first
+	// loses its events.
+	if (exited >= trace::exited_threads_kept && oldest) {
+		oldest->m_state.store(trace_ring::live, std::memory_order_relaxed);
+		return oldest;
+	}
+
+	return nullptr;
+}
+
+// The calling thread's ring, or null if there are no more TLS slots or no
+// memory for one.  Events recorded without a ring are dropped.
+static trace_ring* current_ring() noexcept
+{
+	if (s_ring_slot == TLS_OUT_OF_INDEXES)
+		return nullptr;
+
+	trace_ring* ring = (trace_ring*) TlsGetValue(s_ring_slot);
+	if (ring)
+		return ring;
+
+	// Waiting for the mutex can fail, if this thread can't get an event to
+	// park on.  That is one more way of not having a ring.
+	try {
+		lock_guard<fair_mutex> lg(s_trace_mutex);
+
+		ring = take_free_ring();
+		if (ring) {
+			ring->m_floor.store(ring->m_head.load(std::memory_order_relaxed), std::memory_order_release);
+		}
+		else {
+			ring = new (std::nothrow) trace_ring;
+			if (!ring)
+				return nullptr;
+
+			ring->m_next = s_rings.load(std::memory_order_relaxed);
+			s_rings.store(ring, std::memory_order_release);
+		}
+
+		ring->m_thread_id = GetCurrentThreadId();
+		ring->m_name[0] = 0;
+		ring->m_exported = false;
+	}
+	catch (const std::system_error&) {
+		return nullptr;
+	}
+
+	TlsSetValue(s_ring_slot, ring);
+	return ring;
+}
+
+void trace::enable() noexcept
+{
+	int64_t expected = 0;
+	s_base_ticks.compare_exchange_strong(expected, detail::now_ticks(), std::memory_order_relaxed);
+	s_enabled.store(true, std::memory_order_relaxed);
+}
+
+void trace::disable() noexcept
+{
+	s_enabled.store(false, std::memory_order_relaxed);
+}
+
+void trace::set_thread_name(const char* name)
+{
+	trace_ring* ring = current_ring();
+	if (!ring)
+		throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again));
+
+	lock_guard<fair_mutex> lg(s_trace_mutex);
+	strncpy(ring->m_name, name ? name : "", sizeof ring->m_name - 1);
+	ring->m_name[sizeof ring->m_name - 1] = 0;
+}
+
+void trace::record_slow(trace_event event, const void* object, uint64_t arg) noexcept
+{
+	trace_ring* ring = current_ring();
+	if (!ring)
+		return;
+
+	uint64_t head = ring->m_head.load(std::memory_order_relaxed);
+	trace_entry& entry = ring->m_entries[head & (events_per_thread - 1)];
+	entry.m_ticks = detail::now_ticks();
+	entry.m_object = object;
+	entry.m_arg = arg;
+	entry.m_event = event;
+	ring->m_head.store(head + 1, std::memory_order_release);
+}
+
+void trace::clear()
+{
+	lock_guard<fair_mutex> lg(s_trace_mutex);
+	for (trace_ring* ring = s_rings.load(std::memory_order_acquire); ring; ring = ring->m_next) {
+		ring->m_floor.store(ring->m_head.load(std::memory_order_acquire), std::memory_order_release);
+
+		int expected = trace_ring::exited;
+		ring->m_state.compare_exchange_strong(expected, trace_ring::unused, std::memory_order_release);
+	}
+}
+
+// Copies out the events of one ring that are still intact.  The owner may be
+// overwriting the oldest ones while we copy, so anything it could have got to
+// by the time we are done is thrown away.
+static void snapshot_ring(trace_ring* ring, std::vector<trace_entry>& out)
+{
+	const uint64_t capacity = trace::events_per_thread;
+
+	uint64_t head = ring->m_head.load(std::memory_order_acquire);
+	uint64_t first = ring->m_floor.load(std::memory_order_acquire);
+	if (head - first > capacity)
+		first = head - capacity;
+
+	out.clear();
+	for (uint64_t i = first; i < head; i++)
+		out.push_back(ring->m_entries[i & (capacity - 1)]);
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t now = ring->m_head.load(std::memory_order_relaxed);
+	if (now - first >= capacity) {
+		uint64_t torn = now - capacity + 1 - first;
+		if (torn >= out.size())
+			out.clear();
+		else
+			out.erase(out.begin(), out.begin() + (ptrdiff_t) torn);
+	}
+}
+
+static double ticks_to_us(int64_t ticks)
+{
+	return double(ticks - s_base_ticks.load(std::memory_order_relaxed)) * 1000000.0 / double(detail::tick_frequency());
+}
+
+static void write_escaped(std::ostream& os, const char* str)
+{
+	for (; *str; str++) {
+		unsigned char c = (unsigned char) *str;
+		if (c == '"' || c == '\\') {
+			os << '\\' << (char) c;
+		}
+		else if (c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof buf, "\\u%04x", c);
+			os << buf;
+		}
+		else {
+			os << (char) c;
+		}
+	}
+}
+
+// Writes one event.  `ph` is the Chrome trace phase, and `extra` holds any
+// further fields, starting with a comma.
+static void write_event(std::ostream& os, bool& first, const char* name, const char* ph, DWORD pid, DWORD tid, int64_t ticks, const char* extra)
+{
+	char buf[128];
+	snprintf(buf, sizeof buf, "\"ph\":\"%s\",\"pid\":%lu,\"tid\":%lu,\"ts\":%.3f", ph, (unsigned long) pid, (unsigned long) tid, ticks_to_us(ticks));
+
+	os << (first ? "\n" : ",\n") << "{\"name\":\"" << name << "\"," << buf << extra << "}";
+	first = false;
+}
+
+// Pairs up the begin and end events of waits and sleeps into complete ("X")
+// events, and turns the rest into instant and async events.
+static void write_ring_events(std::ostream& os, bool& first, DWORD pid, DWORD tid, const std::vector<trace_entry>& events)
+{
+	std::vector<const trace_entry*> pending;
+	char extra[160];
+
+	for (size_t i = 0; i < events.size(); i++) {
+		const trace_entry& e = events[i];
+
+		trace_event begin_event;
+		switch (e.m_event) {
+			case trace_event::lock_acquired: begin_event = trace_event::lock_wait; break;
+			case trace_event::cv_wake:       begin_event = trace_event::cv_wait; break;
+			case trace_event::sleep_end:     begin_event = trace_event::sleep_begin; break;
+			default:                         begin_event = e.m_event; break;
+		}
+
+		switch (e.m_event) {
+			case trace_event::lock_wait:
+			case trace_event::cv_wait:
+			case trace_event::sleep_begin:
+				pending.push_back(&e);
+				continue;
+
+			case trace_event::thread_start:
+				write_event(os, first, "thread start", "i", pid, tid, e.m_ticks, ",\"s\":\"t\"");
+				continue;
+
+			case trace_event::thread_exit:
+				write_event(os, first, "thread exit", "i", pid, tid, e.m_ticks, ",\"s\":\"t\"");
+				continue;
+
+			case trace_event::cv_notify:
+				snprintf(extra, sizeof extra, ",\"s\":\"t\",\"args\":{\"cv\":\"%p\",\"woken\":%llu}", e.m_object, (unsigned long long) e.m_arg);
+				write_event(os, first, "cv notify", "i", pid, tid, e.m_ticks, extra);
+				continue;
+
+			case trace_event::lock_released:
+				snprintf(extra, sizeof extra, ",\"cat\":\"lock\",\"id\":\"%p\"", e.m_object);
+				write_event(os, first, "held", "e", pid, tid, e.m_ticks, extra);
+				continue;
+
+			default:
+				break;
+		}
+
+		// An end event.  Find its begin, if it hasn't been overwritten.
+		const trace_entry* begin = nullptr;
+		for (size_t j = pending.size(); j-- > 0; ) {
+			if (pending[j]->m_event == begin_event && pending[j]->m_object == e.m_object) {
+				begin = pending[j];
+				pending.erase(pending.begin() + (ptrdiff_t) j);
+				break;
+			}
+		}
+
+		if (begin) {
+			double dur = ticks_to_us(e.m_ticks) - ticks_to_us(begin->m_ticks);
+			switch (e.m_event) {
+				case trace_event::lock_acquired:
+					snprintf(extra, sizeof extra, ",\"dur\":%.3f,\"args\":{\"mutex\":\"%p\"}", dur, e.m_object);
+					write_event(os, first, "lock wait", "X", pid, tid, begin->m_ticks, extra);
+					break;
+				case trace_event::cv_wake:
+					snprintf(extra, sizeof extra, ",\"dur\":%.3f,\"args\":{\"cv\":\"%p\",\"timed_out\":%s}", dur, e.m_object, e.m_arg ? "true" : "false");
+					write_event(os, first, "cv wait", "X", pid, tid, begin->m_ticks, extra);
+					break;
+				default:
+					snprintf(extra, sizeof extra, ",\"dur\":%.3f,\"args\":{\"requested_us\":%.3f}", dur, double(begin->m_arg) / 1000.0);
+					write_event(os, first, "sleep", "X", pid, tid, begin->m_ticks, extra);
+					break;
+			}
+		}
+
+		// Holding a mutex isn't nested with anything else on the thread, so
+		// it goes on its own async track, keyed by the mutex.
+		if (e.m_event == trace_event::lock_acquired) {
+			snprintf(extra, sizeof extra, ",\"cat\":\"lock\",\"id\":\"%p\",\"args\":{\"mutex\":\"%p\"}", e.m_object, e.m_object);
+			write_event(os, first, "held", "b", pid, tid, e.m_ticks, extra);
+		}
+	}
+}
+
+void trace::export_chrome_json(std::ostream& os)
+{
+	DWORD pid = GetCurrentProcessId();
+	std::vector<trace_entry> events;
+	bool first = true;
+
+	os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	lock_guard<fair_mutex> lg(s_trace_mutex);
+	for (trace_ring* ring = s_rings.load(std::memory_order_acquire); ring; ring = ring->m_next) {
+		if (ring->m_state.load(std::memory_order_acquire) == trace_ring::unused)
+			continue;
+
+		if (ring->m_name[0]) {
+			os << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << (unsigned long) pid
+				<< ",\"tid\":" << (unsigned long) ring->m_thread_id << ",\"args\":{\"name\":\"";
+			write_escaped(os, ring->m_name);
+			os << "\"}}";
+			first = false;
+		}
+
+		// Checked before copying, so that nothing recorded after the copy
+		// can be lost when the ring is handed on.
+		bool exited = ring->m_state.load(std::memory_order_acquire) == trace_ring::exited;
+
+		snapshot_ring(ring, events);
+		write_ring_events(os, first, pid, ring->m_thread_id, events);
+
+		if (exited)
+			ring->m_exported = true;
+	}
+
+	os << "\n]}\n";
+}
+
+} // namespace iprog